@@ -1,13 +1,21 @@
+#define _GNU_SOURCE // memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <termios.h>
+#include "shmring.h"
+#include "crc32c.h"
+#include "transport.h"
 
 #define PORT 12500
 #define BUFFER_SIZE (512 * 1024)
+#define SMALL_BUFFER_SIZE 4096 // commands and short server replies
 #define MAX_USERS 20
+#define END_MARKER "<END_OF_FILE>"
 
 typedef struct {
     char username[20];
@@ -18,6 +26,12 @@ User users[MAX_USERS];
 int user_count = 0;
 char current_user[20] = ""; // Track the currently selected user
 char current_group[20] = ""; // Track the group of the selected user
+// Single reusable buffer for file content; only uploads and downloads need BUFFER_SIZE
+// (plus room for the end marker and checksums of a full file)
+static char data_buffer[BUFFER_SIZE + SMALL_BUFFER_SIZE];
+// Set once the server has handed over shared-memory rings
+static ShmChannel shm;
+static int use_shm = 0;
 
 void initial_menu(int client_socket);
 void user_menu(int client_socket);
@@ -26,49 +40,22 @@ void list_users(int client_socket);
 void set_non_canonical_mode();
 void reset_terminal_mode();
 
-
-// Added function: read until newline or EOF, used for simple responses to general commands
-void read_until_newline_or_eof(int client_socket) {
-    char buf[BUFFER_SIZE];
-    memset(buf, 0, sizeof(buf));
-    int bytes_read = read(client_socket, buf, sizeof(buf) - 1);
-    if (bytes_read > 0) {
-        buf[bytes_read] = '\0';
-        // Directly print the received data, assuming the server appends '\n' at the end of the response
-        printf("Server: %s", buf);
-    } else {
-        printf("Server disconnected or no data.\n");
+// All traffic goes through these, whichever transport was negotiated
+ssize_t client_read(int client_socket, void *buf, size_t count) {
+    if (use_shm) {
+        return shm_read(&shm, buf, count);
     }
+    return read(client_socket, buf, count);
 }
 
-// Used to read the file contents from the "read" command until it encounters <END_OF_FILE>
-void read_until_end_of_file(int client_socket) {
-    char read_buf[BUFFER_SIZE];
-    printf("Server: ");
-    while (1) {
-        int bytes_read = read(client_socket, read_buf, sizeof(read_buf) - 1);
-        if (bytes_read <= 0) {
-            // Connection interrupted or no data
-            break;
-        }
-        read_buf[bytes_read] = '\0';
-
-        // Check if the END marker is included
-        char *end_marker = strstr(read_buf, "<END_OF_FILE>");
-        if (end_marker != NULL) {
-            // Truncate everything after the END marker
-            *end_marker = '\0';
-            printf("%s", read_buf);
-            printf("\n"); // New line after finishing
-            break; // End of reading loop
-        } else {
-            // The END marker has not appeared yet, so print it directly
-            printf("%s", read_buf);
-        }
+ssize_t client_write(int client_socket, const void *buf, size_t count) {
+    if (use_shm) {
+        return shm_write(&shm, buf, count);
     }
+    return send(client_socket, buf, count, 0);
 }
 
-int main() {
+int connect_tcp() {
     int client_socket;
     struct sockaddr_in server_address;
 
@@ -92,18 +79,242 @@ int main() {
         perror("Connection failed");
         exit(EXIT_FAILURE);
     }
+    return client_socket;
+}
+
+// Returns -1 if the server has no Unix socket at `path`
+int connect_local(const char *path) {
+    struct sockaddr_un address;
+    int client_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client_socket < 0) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    if (connect(client_socket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(client_socket);
+        return -1;
+    }
+    return client_socket;
+}
+
+
+// Added function: read until newline or EOF, used for simple responses to general commands
+void read_until_newline_or_eof(int client_socket) {
+    char buf[SMALL_BUFFER_SIZE];
+    int bytes_read = client_read(client_socket, buf, sizeof(buf) - 1);
+    if (bytes_read > 0) {
+        buf[bytes_read] = '\0';
+        // Directly print the received data, assuming the server appends '\n' at the end of the response
+        printf("Server: %s", buf);
+    } else {
+        printf("Server disconnected or no data.\n");
+    }
+}
+
+// Check content against the checksums the server appended after the marker:
+// " crc32c size=<n> chunk=<bytes> sums=<hex>,<hex>,..."
+void verify_checksums(const char *content, int len, const char *trailer) {
+    int size, chunk, pos = 0;
+    if (sscanf(trailer, " crc32c size=%d chunk=%d sums=%n", &size, &chunk, &pos) != 2 || pos == 0 || chunk <= 0) {
+        return; // ls and refusals carry no checksums
+    }
+    if (size != len) {
+        printf("Checksum: FAILED, expected %d bytes but received %d.\n", size, len);
+        return;
+    }
+    const char *sums = trailer + pos;
+    int chunks = 0;
+    for (int start = 0; start < len; start += chunk, chunks++) {
+        unsigned int expected;
+        int n = len - start < chunk ? len - start : chunk;
+        if (sscanf(sums, "%8x", &expected) != 1) {
+            printf("Checksum: FAILED, no checksum for chunk %d.\n", chunks);
+            return;
+        }
+        if (crc32c(0, content + start, n) != expected) {
+            printf("Checksum: FAILED in chunk %d (bytes %d-%d).\n", chunks, start, start + n - 1);
+            return;
+        }
+        sums += strcspn(sums, ",\n");
+        if (*sums == ',') {
+            sums++;
+        }
+    }
+    printf("Checksum: OK (%d bytes, %d chunks, crc32c).\n", len, chunks);
+}
+
+// Used to read the file contents from the "read" command until it encounters <END_OF_FILE>
+void read_until_end_of_file(int client_socket) {
+    char *read_buf = data_buffer;
+    size_t capacity = sizeof(data_buffer) - 1;
+    size_t len = 0;
+    char *end_marker = NULL;
+    while (len < capacity) {
+        int bytes_read = client_read(client_socket, read_buf + len, capacity - len);
+        if (bytes_read <= 0) {
+            // Connection interrupted or no data
+            break;
+        }
+        // Only the new bytes (and a marker straddling them) need scanning
+        size_t from = len > strlen(END_MARKER) ? len - strlen(END_MARKER) : 0;
+        len += bytes_read;
+        read_buf[len] = '\0';
+        if (end_marker == NULL) {
+            end_marker = memmem(read_buf + from, len - from, END_MARKER, strlen(END_MARKER));
+        }
+        // A checksum trailer runs to the end of its line; otherwise the
+        // reply ends at the marker
+        if (end_marker != NULL) {
+            const char *after = end_marker + strlen(END_MARKER);
+            if (strncmp(after, " crc32c", 7) != 0 || strchr(after, '\n') != NULL) {
+                break;
+            }
+        }
+    }
+
+    if (end_marker == NULL) {
+        printf("Server: %s\n", read_buf);
+        return;
+    }
+    // Truncate everything after the END marker
+    *end_marker = '\0';
+    printf("Server: %s", read_buf);
+    printf("\n"); // New line after finishing
+
+    // The server puts a newline between the content and the marker
+    int content_len = end_marker - read_buf;
+    if (content_len > 0 && read_buf[content_len - 1] == '\n') {
+        content_len--;
+    }
+    verify_checksums(read_buf, content_len, end_marker + strlen(END_MARKER));
+}
+
+// Print a grep reply as it arrives. Each match is "<offset>:<length>:<line>\n"
+// and is printed as "<offset>:<line>"; the length is what tells a line that
+// contains "<END_OF_FILE>" from the end of the reply. The reply ends with
+// "<END_OF_FILE> matches=<n>\n", and any other line (a refusal) is printed
+// as it is.
+void stream_until_end_of_file(int client_socket) {
+    char buf[SMALL_BUFFER_SIZE + 1];
+    size_t len = 0, pos = 0;
+    size_t remaining = 0; // bytes of the current match, newline included, still to print
+    printf("Server:\n");
+    while (1) {
+        while (pos < len) {
+            char *line = buf + pos;
+            size_t avail = len - pos;
+            if (remaining > 0) {
+                size_t n = avail < remaining ? avail : remaining;
+                fwrite(line, 1, n, stdout);
+                pos += n;
+                remaining -= n;
+                continue;
+            }
+            if (*line >= '0' && *line <= '9') {
+                size_t offset, length;
+                int header = 0;
+                if (sscanf(line, "%zu:%zu:%n", &offset, &length, &header) == 2 && header > 0) {
+                    printf("%zu:", offset);
+                    pos += header;
+                    remaining = length + 1;
+                    continue;
+                }
+                if (avail < 48) {
+                    break; // the header is still arriving
+                }
+            }
+            char *newline = memchr(line, '\n', avail);
+            if (newline == NULL) {
+                break;
+            }
+            if (strncmp(line, END_MARKER, strlen(END_MARKER)) == 0) {
+                long matches;
+                if (sscanf(line + strlen(END_MARKER), " matches=%ld", &matches) == 1) {
+                    printf("(%ld matching lines)\n", matches);
+                }
+                return;
+            }
+            fwrite(line, 1, newline + 1 - line, stdout);
+            pos += newline + 1 - line;
+        }
+
+        // Keep the unfinished line; one that fills the buffer is printed as is
+        len -= pos;
+        memmove(buf, buf + pos, len);
+        pos = 0;
+        if (len == SMALL_BUFFER_SIZE) {
+            fwrite(buf, 1, len, stdout);
+            len = 0;
+        }
+        int bytes_read = client_read(client_socket, buf + len, SMALL_BUFFER_SIZE - len);
+        if (bytes_read <= 0) {
+            printf("\nServer disconnected before the end of the reply.\n");
+            return;
+        }
+        len += bytes_read;
+        buf[len] = '\0';
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int client_socket = -1;
+    const char *transport = "auto";
+    const char *socket_path = DEFAULT_SOCKET_PATH;
+    int opt;
+
+    // -x tcp|unix|shm picks the transport; by default shared memory is tried
+    // first and TCP is used when the server has no Unix socket
+    while ((opt = getopt(argc, argv, "x:U:")) != -1) {
+        switch (opt) {
+        case 'x':
+            transport = optarg;
+            break;
+        case 'U':
+            socket_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-x auto|tcp|unix|shm] [-U socket_path]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    printf("Connected to the server.\n");
+    const char *connected = "tcp";
+    if (strcmp(transport, "tcp") != 0) {
+        client_socket = connect_local(socket_path);
+        if (client_socket < 0 && strcmp(transport, "auto") != 0) {
+            perror(socket_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (client_socket >= 0) {
+        connected = "unix socket";
+        if (strcmp(transport, "unix") != 0) {
+            send_command(client_socket, "transport shm");
+            use_shm = shm_channel_accept(&shm, client_socket) == 0;
+            if (use_shm) {
+                connected = "shared memory";
+            }
+        }
+    } else {
+        client_socket = connect_tcp();
+    }
+
+    printf("Connected to the server (%s).\n", connected);
 
     // Initial menu to create/select users
     initial_menu(client_socket);
 
+    if (use_shm) {
+        shm_channel_close(&shm);
+    }
     close(client_socket);
     return 0;
 }
 
 void initial_menu(int client_socket) {
-    char command[BUFFER_SIZE] = {0};
+    char command[SMALL_BUFFER_SIZE];
     int choice;
 
     while (1) {
@@ -148,7 +359,7 @@ void initial_menu(int client_socket) {
                 continue;
             }
             getchar();
-            snprintf(command, BUFFER_SIZE, "create_user %s %s", username, group);
+            snprintf(command, sizeof(command), "create_user %s %s", username, group);
             send_command(client_socket, command);
             read_until_newline_or_eof(client_socket);
         }
@@ -158,11 +369,10 @@ void initial_menu(int client_socket) {
             strncpy(current_group, users[choice - 2].group, sizeof(current_group) - 1);
             current_group[sizeof(current_group) - 1] = '\0';
 
-            snprintf(command, BUFFER_SIZE, "set_user %s", current_user);
+            snprintf(command, sizeof(command), "set_user %s", current_user);
             send_command(client_socket, command);
-            char buffer[BUFFER_SIZE];
-            memset(buffer, 0, sizeof(buffer));
-            int bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
+            char buffer[SMALL_BUFFER_SIZE] = "";
+            int bytes_read = client_read(client_socket, buffer, sizeof(buffer) - 1);
             if (bytes_read > 0) {
                 buffer[bytes_read] = '\0';
                 printf("Server: %s", buffer);
@@ -182,19 +392,24 @@ void initial_menu(int client_socket) {
 }
 
 void user_menu(int client_socket) {
-    char command[BUFFER_SIZE] = {0};
+    char command[SMALL_BUFFER_SIZE];
 
     while (1) {
         printf("\nUser: %s (%s)\n", current_user, current_group);
         printf("Available commands:\n");
-        printf("1. create <filename> <permissions>\n");
-        printf("2. read <filename>\n");
-        printf("3. write <filename> o/a\n");
-        printf("4. mode <filename> <permissions>\n");
-        printf("5. exit\n");
+        printf("1. create <path> [permissions]\n");
+        printf("2. read <path>\n");
+        printf("3. write <path> o/a\n");
+        printf("4. mode <path> <permissions>\n");
+        printf("5. mkdir <path> [permissions]\n");
+        printf("6. ls [path] [after]\n");
+        printf("7. verify <path>\n");
+        printf("8. grep <path> <pattern>\n");
+        printf("9. count <path> <pattern>\n");
+        printf("10. exit\n");
         printf("Enter command: ");
 
-        char input[BUFFER_SIZE] = {0};
+        char input[SMALL_BUFFER_SIZE];
         if (fgets(input, sizeof(input), stdin) == NULL) {
             printf("Invalid input. Please try again.\n");
             continue;
@@ -203,16 +418,17 @@ void user_menu(int client_socket) {
 
         // Special handling for the write command
         char cmd[10];
-        char filename[50];
+        char filename[1024];
         char mode[2];
-        if (sscanf(input, "%s %s %s", cmd, filename, mode) == 3 && strcmp(cmd, "write") == 0) {
+        if (sscanf(input, "%9s %1023s %1s", cmd, filename, mode) == 3 && strcmp(cmd, "write") == 0) {
             set_non_canonical_mode();
-            snprintf(command, BUFFER_SIZE, "write %s %s", filename, mode);
+            // "crc": the upload is sent with its length and checksum
+            snprintf(command, sizeof(command), "write %s %s crc", filename, mode);
             send_command(client_socket, command);
 
             // Wait for server confirmation
-            char buffer[BUFFER_SIZE] = {0};
-            int bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
+            char buffer[SMALL_BUFFER_SIZE] = "";
+            int bytes_read = client_read(client_socket, buffer, sizeof(buffer) - 1);
             if (bytes_read > 0) {
                 buffer[bytes_read] = '\0';
                 printf("Server: %s\n", buffer);
@@ -221,20 +437,23 @@ void user_menu(int client_socket) {
             // If it is ready to write
             if (strstr(buffer, "Ready to write") != NULL) {
                 printf("Enter content to write: ");
-                char content[BUFFER_SIZE] = {0};
-                if (fgets(content, sizeof(content), stdin) == NULL) {
+                char *content = data_buffer;
+                if (fgets(content, BUFFER_SIZE, stdin) == NULL) {
                     printf("Failed to read content. Aborting write command.\n");
                     reset_terminal_mode();
                     continue;
                 }
                 content[strcspn(content, "\n")] = '\0';
 
-                send_command(client_socket, content);
+                char header[32];
+                size_t content_len = strlen(content);
+                snprintf(header, sizeof(header), "%zu %08x\n", content_len, crc32c(0, content, content_len));
+                send_command(client_socket, header);
+                client_write(client_socket, content, content_len);
                 reset_terminal_mode();
 
                 // Receive notification of completion
-                memset(buffer, 0, sizeof(buffer));
-                bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
+                bytes_read = client_read(client_socket, buffer, sizeof(buffer) - 1);
                 if (bytes_read > 0) {
                     buffer[bytes_read] = '\0';
                     printf("Server: %s\n", buffer);
@@ -243,13 +462,20 @@ void user_menu(int client_socket) {
             continue;
         }
 
-        // Special handling for the read command (repeated reads until <END_OF_FILE>)
-        if (strncmp(input, "read ", 5) == 0) {
+        // Special handling for the read and ls commands (repeated reads until <END_OF_FILE>)
+        if (strncmp(input, "read ", 5) == 0 || strcmp(input, "ls") == 0 || strncmp(input, "ls ", 3) == 0) {
             send_command(client_socket, input);
             read_until_end_of_file(client_socket);
             continue;
         }
 
+        // grep streams matching lines, possibly more than fit in memory at once
+        if (strncmp(input, "grep ", 5) == 0) {
+            send_command(client_socket, input);
+            stream_until_end_of_file(client_socket);
+            continue;
+        }
+
         // show_capability_list or other brief response commands
         if (strcmp(input, "show_capability_list") == 0 || strcmp(input, "5") == 0) {
             send_command(client_socket, input);
@@ -257,7 +483,7 @@ void user_menu(int client_socket) {
             continue;
         }
 
-        if (strcmp(input, "exit") == 0 || strcmp(input, "6") == 0) {
+        if (strcmp(input, "exit") == 0 || strcmp(input, "10") == 0) {
             printf("Returning to main menu.\n");
             break;
         }
@@ -271,15 +497,14 @@ void user_menu(int client_socket) {
 }
 
 void send_command(int client_socket, const char *command) {
-    send(client_socket, command, strlen(command), 0);
+    client_write(client_socket, command, strlen(command));
 }
 
 void list_users(int client_socket) {
-    char command[BUFFER_SIZE] = "list_users";
-    send_command(client_socket, command);
+    send_command(client_socket, "list_users");
 
-    char buffer[BUFFER_SIZE] = {0};
-    int bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
+    char buffer[SMALL_BUFFER_SIZE];
+    int bytes_read = client_read(client_socket, buffer, sizeof(buffer) - 1);
     if (bytes_read > 0) {
         buffer[bytes_read] = '\0';
         printf("%s", buffer);
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bufpool.h"
+
+// Every buffer is preceded by a header recording its class, so buf_release
+// only needs the data pointer. Free buffers are chained through the header.
+typedef union BufHeader {
+    struct {
+        union BufHeader *next;
+        int cls;
+    } h;
+    max_align_t align;
+} BufHeader;
+
+typedef struct {
+    size_t size;      // usable bytes per buffer
+    int max_cached;   // free buffers kept for reuse, the rest go back to malloc
+    int cached;       // number of buffers currently on the free list
+    BufHeader *free_list;
+    pthread_mutex_t lock;
+} BufSlab;
+
+static BufSlab slabs[] = {
+    [BUF_SMALL] = { SMALL_BUFFER_SIZE, 256, 0, NULL, PTHREAD_MUTEX_INITIALIZER },
+    [BUF_LARGE] = { LARGE_BUFFER_SIZE, 8, 0, NULL, PTHREAD_MUTEX_INITIALIZER },
+};
+
+char *buf_acquire(BufClass cls) {
+    BufSlab *slab = &slabs[cls];
+    BufHeader *hdr;
+
+    pthread_mutex_lock(&slab->lock);
+    hdr = slab->free_list;
+    if (hdr != NULL) {
+        slab->free_list = hdr->h.next;
+        slab->cached--;
+    }
+    pthread_mutex_unlock(&slab->lock);
+
+    if (hdr == NULL) {
+        hdr = malloc(sizeof(BufHeader) + slab->size);
+        if (hdr == NULL) {
+            perror("buffer allocation failed");
+            return NULL;
+        }
+        hdr->h.cls = cls;
+    }
+    return (char *)(hdr + 1);
+}
+
+void buf_release(char *buf) {
+    if (buf == NULL) {
+        return;
+    }
+    BufHeader *hdr = (BufHeader *)buf - 1;
+    BufSlab *slab = &slabs[hdr->h.cls];
+
+    pthread_mutex_lock(&slab->lock);
+    if (slab->cached < slab->max_cached) {
+        hdr->h.next = slab->free_list;
+        slab->free_list = hdr;
+        slab->cached++;
+        hdr = NULL;
+    }
+    pthread_mutex_unlock(&slab->lock);
+
+    free(hdr); // pool full, give it back
+}
+
+size_t buf_capacity(const char *buf) {
+    const BufHeader *hdr = (const BufHeader *)buf - 1;
+    return slabs[hdr->h.cls].size;
+}
@@ -0,0 +1,21 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+
+#define SMALL_BUFFER_SIZE 4096         // control commands and short replies
+#define LARGE_BUFFER_SIZE (512 * 1024) // file content transfer
+
+typedef enum {
+    BUF_SMALL,
+    BUF_LARGE
+} BufClass;
+
+// Take a buffer of the given class from the pool. Contents are NOT zeroed.
+char *buf_acquire(BufClass cls);
+// Return a buffer obtained from buf_acquire to its pool.
+void buf_release(char *buf);
+// Usable size of a pooled buffer.
+size_t buf_capacity(const char *buf);
+
+#endif
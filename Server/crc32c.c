@@ -0,0 +1,161 @@
+#include <string.h>
+#include <pthread.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define HAVE_X86_CRC 1
+#endif
+
+#define POLY 0x82f63b78 // reflected Castagnoli polynomial
+
+// Each stream of the hardware path covers this many bytes per round
+#define STRIPE 4096
+
+// The state below is written once under crc_once and only read afterwards
+static uint32_t table[8][256];
+static uint32_t (*update)(uint32_t crc, const unsigned char *p, size_t len);
+static const char *impl_name;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+// a * b modulo POLY, bit-reflected (bit 31 is x^0)
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, p = 0;
+    while (m != 0) {
+        if (a & m) {
+            p ^= b;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^n modulo POLY
+static uint32_t xpow(uint64_t n) {
+    uint32_t result = 1u << 31, base = 1u << 30;
+    while (n != 0) {
+        if (n & 1) {
+            result = multmodp(result, base);
+        }
+        base = multmodp(base, base);
+        n >>= 1;
+    }
+    return result;
+}
+
+static uint32_t update_sw(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^
+              table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^
+              table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef HAVE_X86_CRC
+// Constants that move a stream's CRC past the STRIPE or 2 * STRIPE bytes
+// that follow it. One factor of x comes from PCLMUL's reflected product and
+// x^32 from the final crc32 reduction, hence the -33.
+static uint64_t shift1_k, shift2_k;
+static uint32_t shift1_x, shift2_x;
+static int have_pclmul;
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t shift_clmul(uint32_t crc, uint64_t k) {
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc), _mm_cvtsi64_si128(k), 0);
+    return _mm_crc32_u64(0, _mm_cvtsi128_si64(product));
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t update_hw(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c0 = crc;
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        c0 = _mm_crc32_u8(c0, *p++);
+        len--;
+    }
+
+    // crc32 has a latency of three cycles but issues one per cycle, so three
+    // independent streams keep it busy
+    while (len >= 3 * STRIPE) {
+        uint64_t c1 = 0, c2 = 0;
+        for (size_t i = 0; i < STRIPE; i += 8) {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p + i, 8);
+            memcpy(&w1, p + STRIPE + i, 8);
+            memcpy(&w2, p + 2 * STRIPE + i, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        if (have_pclmul) {
+            c0 = shift_clmul(c0, shift2_k) ^ shift_clmul(c1, shift1_k) ^ c2;
+        } else {
+            c0 = multmodp(shift2_x, c0) ^ multmodp(shift1_x, c1) ^ c2;
+        }
+        p += 3 * STRIPE;
+        len -= 3 * STRIPE;
+    }
+
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c0 = _mm_crc32_u64(c0, w);
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        c0 = _mm_crc32_u8(c0, *p++);
+    }
+    return (uint32_t)c0;
+}
+#endif
+
+static void crc_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+        }
+        table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+        }
+    }
+    update = update_sw;
+    impl_name = "slicing-by-8";
+
+#ifdef HAVE_X86_CRC
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        shift1_x = xpow(8 * STRIPE);
+        shift2_x = xpow(16 * STRIPE);
+        shift1_k = xpow(8 * STRIPE - 33);
+        shift2_k = xpow(16 * STRIPE - 33);
+        have_pclmul = __builtin_cpu_supports("pclmul");
+        update = update_hw;
+        impl_name = have_pclmul ? "sse4.2+pclmul" : "sse4.2";
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    return ~update(~crc, data, len);
+}
+
+const char *crc32c_impl(void) {
+    pthread_once(&crc_once, crc_init);
+    return impl_name;
+}
@@ -0,0 +1,18 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and SCTP. Uses the SSE4.2
+// crc32 instruction on three interleaved streams, merged with PCLMULQDQ,
+// when the CPU has them; otherwise a portable slicing-by-8 table.
+
+// Extend `crc` (0 to start) over `len` bytes. crc32c(0, "123456789", 9)
+// is 0xe3069283.
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+// Name of the implementation in use, for logs
+const char *crc32c_impl(void);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#define DATASET_MAX_PERMS 8
+#define DATASET_MAX_GROUPS 8
+
+// Synthetic corpus for benchmarks and warm starts, described by a spec like
+// "files=1000000,dirs=1000,min=0,max=4096,dist=exp,owners=6,groups=AOS:CSE,perms=rwr---:rwrwrw,threads=8,seed=1".
+// Files are spread round-robin over /corpus/dNNNNN directories; owners are
+// users load0..loadN-1, whose groups cycle through the groups list.
+typedef struct {
+    long files;
+    int dirs;
+    int min_size;
+    int max_size;
+    char dist;        // 'u' uniform, 'f' fixed at max, 'e' exponential with mean (min+max)/2
+    int owners;
+    char groups[DATASET_MAX_GROUPS][20];
+    int ngroups;      // owner i is in groups[i % ngroups]
+    char perms[DATASET_MAX_PERMS][7];
+    int nperms;       // permission strings are assigned round-robin
+    int threads;
+    unsigned seed;
+} DatasetSpec;
+
+// Parse a spec; unspecified keys keep their defaults. Returns 0 or -1.
+int dataset_parse(const char *text, DatasetSpec *spec);
+
+// Populate the namespace in parallel. Call before clients are accepted.
+// Returns the number of entries created, or -1 on error.
+long dataset_generate(const DatasetSpec *spec);
+
+// Write the whole namespace (and the user table) to an image file. The image
+// is written to "<path>.tmp" and renamed over `path`, so a mapping of the old
+// image (including the one this server may be running from) stays valid.
+// Returns the number of entries written, or -1 on error.
+long dataset_save_image(const char *path);
+
+// Map an image written by dataset_save_image and attach its entries.
+// File content stays in the mapping until first modified. Entries that
+// clash with existing files are skipped. Returns entries added, or -1.
+long dataset_load_image(const char *path, int threads);
+
+#endif
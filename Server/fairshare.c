@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fairshare.h"
+
+struct FairGroup {
+    char name[20];
+    int weight;
+    double ops_rate, bytes_rate; // 0 = unlimited
+    double ops_tokens, bytes_tokens;
+    double refilled_at;
+    double finish; // virtual time at which the group's queued work is done
+    // Usage, for stats
+    long admitted, ops, throttled, waiting;
+    unsigned long long bytes;
+    double wait_total, wait_max;
+    double ops_recent, bytes_recent, recent_at;
+};
+
+// A command waiting for a slot; lives on the waiting thread's stack
+typedef struct Waiter {
+    FairGroup *group;
+    double tag; // virtual start time; the smallest ready tag goes next
+    unsigned long seq;
+    struct Waiter *next;
+} Waiter;
+
+// Everything below is guarded by fair_mutex
+static pthread_mutex_t fair_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fair_cond;
+static pthread_once_t fair_once = PTHREAD_ONCE_INIT;
+static FairGroup groups[FAIR_MAX_GROUPS];
+static int group_count;
+static int slots, busy;
+static double vtime; // start tag of the latest admitted command
+static unsigned long next_seq;
+static Waiter *waiters;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fair_init(void) {
+    // Token waits sleep until a deadline, so use the clock the buckets use
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&fair_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static int default_slots(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 2 ? 2 * cpus : 4;
+}
+
+static double ops_burst(FairGroup *g) {
+    return fmax(1.0, g->ops_rate * FAIR_BURST_SECONDS);
+}
+
+static double bytes_burst(FairGroup *g) {
+    return g->bytes_rate * FAIR_BURST_SECONDS;
+}
+
+// Look up a group, adding it with default settings on first use. Groups
+// come from user accounts (at most MAX_USERS), so the table does not fill
+// in practice; if it does, the last entry is shared.
+static FairGroup *find_group(const char *name) {
+    for (int i = 0; i < group_count; i++) {
+        if (strcmp(groups[i].name, name) == 0) {
+            return &groups[i];
+        }
+    }
+    if (group_count == FAIR_MAX_GROUPS) {
+        return &groups[FAIR_MAX_GROUPS - 1];
+    }
+    FairGroup *g = &groups[group_count++];
+    memset(g, 0, sizeof(*g));
+    strncpy(g->name, name, sizeof(g->name) - 1);
+    g->weight = 1;
+    g->refilled_at = g->recent_at = now_seconds();
+    g->finish = vtime;
+    return g;
+}
+
+static void refill(FairGroup *g, double now) {
+    double elapsed = now - g->refilled_at;
+    if (g->ops_rate > 0) {
+        g->ops_tokens = fmin(ops_burst(g), g->ops_tokens + elapsed * g->ops_rate);
+    }
+    if (g->bytes_rate > 0) {
+        g->bytes_tokens = fmin(bytes_burst(g), g->bytes_tokens + elapsed * g->bytes_rate);
+    }
+    g->refilled_at = now;
+}
+
+// An op needs a whole token; bytes only need the bucket out of debt, since
+// how many a command moves is known only when it ends
+static int has_tokens(FairGroup *g) {
+    return (g->ops_rate == 0 || g->ops_tokens >= 1) && (g->bytes_rate == 0 || g->bytes_tokens >= 0);
+}
+
+// Seconds until has_tokens(g) becomes true
+static double token_delay(FairGroup *g) {
+    double delay = 0;
+    if (g->ops_rate > 0 && g->ops_tokens < 1) {
+        delay = (1 - g->ops_tokens) / g->ops_rate;
+    }
+    if (g->bytes_rate > 0 && g->bytes_tokens < 0) {
+        delay = fmax(delay, -g->bytes_tokens / g->bytes_rate);
+    }
+    return delay;
+}
+
+// The waiter to admit next: smallest start tag among groups with tokens,
+// oldest first on ties
+static Waiter *next_waiter(double now) {
+    Waiter *best = NULL;
+    for (Waiter *w = waiters; w != NULL; w = w->next) {
+        refill(w->group, now);
+        if (has_tokens(w->group) &&
+            (best == NULL || w->tag < best->tag || (w->tag == best->tag && w->seq < best->seq))) {
+            best = w;
+        }
+    }
+    return best;
+}
+
+static int parse_rate(const char *text, double *rate) {
+    char *end;
+    *rate = strtod(text, &end);
+    if (end == text || *rate < 0) {
+        return -1;
+    }
+    if (*end == 'K' || *end == 'k') {
+        *rate *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        *rate *= 1024 * 1024;
+        end++;
+    } else if (*end == 'G' || *end == 'g') {
+        *rate *= 1024.0 * 1024 * 1024;
+        end++;
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+int fair_configure(const char *spec) {
+    char name[20], ops[32] = "0", bytes[32] = "0";
+    int weight;
+    double ops_rate, bytes_rate;
+    int fields = sscanf(spec, "%19[^:]:%d:%31[^:]:%31s", name, &weight, ops, bytes);
+    if (fields < 2 || weight < 1 || parse_rate(ops, &ops_rate) < 0 || parse_rate(bytes, &bytes_rate) < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&fair_mutex);
+    FairGroup *g = find_group(name);
+    g->weight = weight;
+    g->ops_rate = ops_rate;
+    g->bytes_rate = bytes_rate;
+    g->ops_tokens = ops_burst(g);
+    g->bytes_tokens = bytes_burst(g);
+    pthread_mutex_unlock(&fair_mutex);
+    return 0;
+}
+
+void fair_set_slots(int n) {
+    pthread_mutex_lock(&fair_mutex);
+    slots = n;
+    pthread_mutex_unlock(&fair_mutex);
+}
+
+int fair_slots(void) {
+    pthread_mutex_lock(&fair_mutex);
+    if (slots == 0) {
+        slots = default_slots();
+    }
+    int n = slots;
+    pthread_mutex_unlock(&fair_mutex);
+    return n;
+}
+
+void fair_begin(FairTicket *ticket, const char *group) {
+    pthread_once(&fair_once, fair_init);
+    pthread_mutex_lock(&fair_mutex);
+    if (slots == 0) {
+        slots = default_slots();
+    }
+    double arrived = now_seconds(), now = arrived;
+    FairGroup *g = find_group(group[0] != '\0' ? group : "(none)");
+
+    // Start after the group's earlier work, but never in the past: an idle
+    // group does not bank credit. The op is charged to the group now and
+    // its bytes when it ends.
+    Waiter self = { g, fmax(vtime, g->finish), next_seq++, waiters };
+    g->finish = self.tag + 1.0 / g->weight;
+    waiters = &self;
+    g->waiting++;
+
+    int throttled = 0;
+    while (busy >= slots || next_waiter(now) != &self) {
+        if (!has_tokens(g)) {
+            if (!throttled) {
+                g->throttled++;
+                throttled = 1;
+            }
+            double wake = now + token_delay(g);
+            struct timespec deadline = { (time_t)wake, (long)((wake - (time_t)wake) * 1e9) };
+            pthread_cond_timedwait(&fair_cond, &fair_mutex, &deadline);
+        } else {
+            pthread_cond_wait(&fair_cond, &fair_mutex);
+        }
+        now = now_seconds();
+    }
+
+    Waiter **link = &waiters;
+    while (*link != &self) {
+        link = &(*link)->next;
+    }
+    *link = self.next;
+    busy++;
+    vtime = fmax(vtime, self.tag);
+    if (g->ops_rate > 0) {
+        g->ops_tokens -= 1;
+    }
+    g->waiting--;
+    g->admitted++;
+    g->wait_total += now - arrived;
+    g->wait_max = fmax(g->wait_max, now - arrived);
+    // Another waiter may fit in a slot that is still free
+    if (busy < slots && waiters != NULL) {
+        pthread_cond_broadcast(&fair_cond);
+    }
+    pthread_mutex_unlock(&fair_mutex);
+    ticket->group = g;
+    ticket->held = 1;
+}
+
+// Caller holds fair_mutex
+static void release_slot(FairTicket *ticket) {
+    busy--;
+    ticket->held = 0;
+    if (waiters != NULL) {
+        pthread_cond_broadcast(&fair_cond);
+    }
+}
+
+void fair_yield(FairTicket *ticket) {
+    if (!ticket->held) {
+        return;
+    }
+    pthread_mutex_lock(&fair_mutex);
+    release_slot(ticket);
+    pthread_mutex_unlock(&fair_mutex);
+}
+
+void fair_end(FairTicket *ticket, unsigned long bytes) {
+    FairGroup *g = ticket->group;
+    pthread_mutex_lock(&fair_mutex);
+    double now = now_seconds();
+    if (ticket->held) {
+        release_slot(ticket);
+    }
+    g->ops++;
+    g->bytes += bytes;
+    if (g->bytes_rate > 0) {
+        refill(g, now);
+        g->bytes_tokens -= bytes;
+    }
+    g->finish += (double)bytes / FAIR_BYTES_PER_OP / g->weight;
+
+    // Exponentially decaying rates, so stats shows current load
+    double decay = exp(-(now - g->recent_at) / FAIR_RATE_WINDOW);
+    g->ops_recent = g->ops_recent * decay + 1 / FAIR_RATE_WINDOW;
+    g->bytes_recent = g->bytes_recent * decay + bytes / FAIR_RATE_WINDOW;
+    g->recent_at = now;
+    // Paying off bytes may let a throttled waiter through
+    if (waiters != NULL) {
+        pthread_cond_broadcast(&fair_cond);
+    }
+    pthread_mutex_unlock(&fair_mutex);
+    ticket->group = NULL;
+}
+
+void fair_stats(char *out, size_t size) {
+    pthread_mutex_lock(&fair_mutex);
+    double now = now_seconds();
+    long waiting = 0;
+    for (int i = 0; i < group_count; i++) {
+        waiting += groups[i].waiting;
+    }
+    size_t len = snprintf(out, size, "Scheduler: %d slots, %d busy, %ld waiting\n",
+                          slots ? slots : default_slots(), busy, waiting);
+    len += snprintf(out + len, len < size ? size - len : 0, "%-10s %6s %9s %9s %9s %9s %8s %8s %9s %9s %9s\n",
+                    "group", "weight", "max ops/s", "max MB/s", "ops", "MB", "ops/s", "MB/s",
+                    "avg wait", "max wait", "throttled");
+    for (int i = 0; i < group_count && len < size; i++) {
+        FairGroup *g = &groups[i];
+        char ops_limit[16] = "-", bytes_limit[16] = "-";
+        if (g->ops_rate > 0) {
+            snprintf(ops_limit, sizeof(ops_limit), "%.0f", g->ops_rate);
+        }
+        if (g->bytes_rate > 0) {
+            snprintf(bytes_limit, sizeof(bytes_limit), "%.1f", g->bytes_rate / (1024 * 1024));
+        }
+        double decay = exp(-(now - g->recent_at) / FAIR_RATE_WINDOW);
+        len += snprintf(out + len, size - len, "%-10s %6d %9s %9s %9ld %9.1f %8.0f %8.1f %7.2fms %7.2fms %9ld\n",
+                        g->name, g->weight, ops_limit, bytes_limit, g->ops, g->bytes / (1024.0 * 1024),
+                        g->ops_recent * decay, g->bytes_recent * decay / (1024 * 1024),
+                        g->admitted ? g->wait_total / g->admitted * 1000 : 0, g->wait_max * 1000, g->throttled);
+    }
+    pthread_mutex_unlock(&fair_mutex);
+}
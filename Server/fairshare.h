@@ -0,0 +1,51 @@
+#ifndef FAIRSHARE_H
+#define FAIRSHARE_H
+
+#include <stddef.h>
+
+// Per-group fair-share admission for client commands. At most `slots`
+// commands run at once; when they are all busy, waiting commands are
+// admitted in start-time fair queueing order, so each group gets service in
+// proportion to its weight however many clients it has. A slot covers the
+// command's work in the server only: it is given back before the command
+// sleeps or blocks on its client, so slow clients cannot starve the rest. A group may also
+// be capped with token buckets for ops/s and bytes/s. Bytes are charged
+// when a command ends, so a large transfer puts its group in debt and the
+// group's next command waits until the bucket is back above zero.
+
+#define FAIR_MAX_GROUPS 32
+#define FAIR_BYTES_PER_OP (64 * 1024) // bytes that weigh as much as one op in the queue
+#define FAIR_BURST_SECONDS 1.0        // bucket depth, in seconds of the rate
+#define FAIR_RATE_WINDOW 5.0          // time constant of the recent rates in stats
+
+typedef struct FairGroup FairGroup;
+
+typedef struct FairTicket {
+    FairGroup *group;
+    int held; // still occupying a slot
+} FairTicket;
+
+// Configure a group from "name:weight[:ops_per_sec[:bytes_per_sec]]"; a rate
+// of 0 means unlimited and bytes take K, M or G suffixes. Groups that are
+// never configured get weight 1 and no limits. Returns 0, or -1 if invalid.
+int fair_configure(const char *spec);
+
+// Number of commands that may run at once; by default twice the CPUs, at
+// least 4.
+void fair_set_slots(int slots);
+int fair_slots(void);
+
+// Wait until a command from `group` may run. Every fair_begin must be
+// followed by fair_end with the bytes the command moved.
+void fair_begin(FairTicket *ticket, const char *group);
+void fair_end(FairTicket *ticket, unsigned long bytes);
+
+// Give the slot back before the command waits on something other than the
+// CPU; the ticket stays open until fair_end charges its bytes. Does nothing
+// if the slot was already given back.
+void fair_yield(FairTicket *ticket);
+
+// Per-group limits, usage and queueing delay, as a text table.
+void fair_stats(char *out, size_t size);
+
+#endif
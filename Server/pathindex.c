@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pathindex.h"
+
+// Internal crit-bit node. `pos` is the index of the first bit (MSB first)
+// where the keys of its two subtrees differ; child[0] holds keys with that
+// bit clear. Child pointers with the low bit set are internal nodes, all
+// others are PathNode leaves.
+typedef struct CritNode {
+    void *child[2];
+    size_t pos;
+} CritNode;
+
+#define IS_INTERNAL(p) (((uintptr_t)(p)) & 1)
+#define TO_INTERNAL(p) ((CritNode *)((uintptr_t)(p) - 1))
+#define TAG_INTERNAL(q) ((void *)((uintptr_t)(q) + 1))
+
+// Bit `pos` of a key, reading bytes past its end as zero.
+static int key_bit(const char *key, size_t len, size_t pos) {
+    size_t byte = pos >> 3;
+    if (byte >= len) {
+        return 0;
+    }
+    return (((unsigned char)key[byte]) >> (7 - (pos & 7))) & 1;
+}
+
+// First bit position where two keys differ, or SIZE_MAX if they are equal.
+static size_t first_diff(const char *a, size_t alen, const char *b, size_t blen) {
+    size_t n = alen > blen ? alen : blen;
+    for (size_t i = 0; i < n; i++) {
+        unsigned ca = i < alen ? (unsigned char)a[i] : 0;
+        unsigned cb = i < blen ? (unsigned char)b[i] : 0;
+        if (ca != cb) {
+            return i * 8 + (__builtin_clz(ca ^ cb) - 24);
+        }
+    }
+    return SIZE_MAX;
+}
+
+static int compare_name(const PathNode *node, const char *key, size_t len) {
+    size_t n = node->name_len < len ? node->name_len : len;
+    int c = memcmp(node->name, key, n);
+    if (c != 0) {
+        return c;
+    }
+    return (node->name_len > len) - (node->name_len < len);
+}
+
+// Leaf reached by following the bits of `key` from `p`.
+static PathNode *best_match(void *p, const char *key, size_t len) {
+    while (IS_INTERNAL(p)) {
+        CritNode *q = TO_INTERNAL(p);
+        p = q->child[key_bit(key, len, q->pos)];
+    }
+    return p;
+}
+
+static PathNode *crit_find(void *tree, const char *key, size_t len) {
+    if (tree == NULL) {
+        return NULL;
+    }
+    PathNode *leaf = best_match(tree, key, len);
+    return compare_name(leaf, key, len) == 0 ? leaf : NULL;
+}
+
+static int crit_insert(void **tree, PathNode *leaf) {
+    if (*tree == NULL) {
+        *tree = leaf;
+        return 1;
+    }
+
+    PathNode *best = best_match(*tree, leaf->name, leaf->name_len);
+    size_t pos = first_diff(leaf->name, leaf->name_len, best->name, best->name_len);
+    if (pos == SIZE_MAX) {
+        return 0; // already present
+    }
+
+    CritNode *node = malloc(sizeof(CritNode));
+    if (node == NULL) {
+        return -1;
+    }
+    int dir = key_bit(leaf->name, leaf->name_len, pos);
+    node->pos = pos;
+    node->child[dir] = leaf;
+
+    // Splice in above the first node that tests a later bit
+    void **where = tree;
+    while (IS_INTERNAL(*where)) {
+        CritNode *q = TO_INTERNAL(*where);
+        if (q->pos > pos) {
+            break;
+        }
+        where = &q->child[key_bit(leaf->name, leaf->name_len, q->pos)];
+    }
+    node->child[1 - dir] = *where;
+    *where = TAG_INTERNAL(node);
+    return 1;
+}
+
+typedef struct {
+    path_visit_fn fn;
+    void *ctx;
+    long limit;
+    long visited;
+    int more;
+    int stop;
+} ListState;
+
+static void visit(ListState *st, PathNode *leaf) {
+    if (st->stop) {
+        return;
+    }
+    if (st->limit >= 0 && st->visited >= st->limit) {
+        st->more = 1;
+        st->stop = 1;
+        return;
+    }
+    st->visited++;
+    if (st->fn(leaf, st->ctx)) {
+        st->stop = 1;
+    }
+}
+
+static void walk_all(void *p, ListState *st) {
+    while (!st->stop && IS_INTERNAL(p)) {
+        CritNode *q = TO_INTERNAL(p);
+        walk_all(q->child[0], st);
+        p = q->child[1];
+    }
+    if (!st->stop) {
+        visit(st, p);
+    }
+}
+
+// In-order walk of the leaves strictly greater than `after`. `crit` is the
+// first bit where `after` differs from its best-matching leaf in this
+// subtree: above it `after` shares every subtree's common prefix, so the
+// walk can steer by its bits; below it a whole subtree is either entirely
+// before or entirely after the cursor.
+static void walk_after(void *p, const char *after, size_t alen, size_t crit, ListState *st) {
+    while (!st->stop && IS_INTERNAL(p)) {
+        CritNode *q = TO_INTERNAL(p);
+        if (q->pos > crit) {
+            if (key_bit(after, alen, crit) == 0) {
+                walk_all(p, st);
+            }
+            return;
+        }
+        if (key_bit(after, alen, q->pos) == 0) {
+            walk_after(q->child[0], after, alen, crit, st);
+            walk_all(q->child[1], st);
+            return;
+        }
+        p = q->child[1];
+    }
+    if (!st->stop && compare_name(p, after, alen) > 0) {
+        visit(st, p);
+    }
+}
+
+PathNode *path_new_root(void *data) {
+    PathNode *root = calloc(1, sizeof(PathNode));
+    if (root == NULL) {
+        return NULL;
+    }
+    root->name = strdup("");
+    root->is_dir = 1;
+    root->data = data;
+    return root;
+}
+
+int path_valid_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len > MAX_NAME_LEN || strchr(name, '/') != NULL) {
+        return 0;
+    }
+    return strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+// Copy the next component of *path into `name` and advance past it.
+// Returns 0 at the end of the path, -1 if the component is too long.
+static int next_component(const char **path, char *name, size_t name_size) {
+    const char *p = *path;
+    while (*p == '/') {
+        p++;
+    }
+    if (*p == '\0') {
+        *path = p;
+        return 0;
+    }
+    size_t len = strcspn(p, "/");
+    if (len >= name_size) {
+        return -1;
+    }
+    memcpy(name, p, len);
+    name[len] = '\0';
+    *path = p + len;
+    return 1;
+}
+
+PathNode *path_lookup(PathNode *root, const char *path) {
+    char name[MAX_NAME_LEN + 1];
+    PathNode *node = root;
+    int r;
+    while ((r = next_component(&path, name, sizeof(name))) > 0) {
+        if (!node->is_dir) {
+            return NULL;
+        }
+        node = crit_find(node->children, name, strlen(name));
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    return r == 0 ? node : NULL;
+}
+
+PathNode *path_lookup_parent(PathNode *root, const char *path, char *leaf, size_t leaf_size) {
+    char name[MAX_NAME_LEN + 1];
+    PathNode *dir = root;
+    int have_name = 0;
+    int r;
+    while ((r = next_component(&path, name, sizeof(name))) > 0) {
+        if (have_name) {
+            // The previous component turned out not to be the last one
+            dir = dir->is_dir ? crit_find(dir->children, leaf, strlen(leaf)) : NULL;
+            if (dir == NULL) {
+                return NULL;
+            }
+        }
+        if (strlen(name) >= leaf_size) {
+            return NULL;
+        }
+        strcpy(leaf, name);
+        have_name = 1;
+    }
+    if (r < 0 || !have_name || !dir->is_dir || !path_valid_name(leaf)) {
+        return NULL;
+    }
+    return dir;
+}
+
+PathNode *path_add_child(PathNode *dir, const char *name, int is_dir, void *data) {
+    PathNode *node = calloc(1, sizeof(PathNode));
+    if (node == NULL) {
+        return NULL;
+    }
+    node->name = strdup(name);
+    if (node->name == NULL) {
+        free(node);
+        return NULL;
+    }
+    node->name_len = strlen(name);
+    node->parent = dir;
+    node->is_dir = is_dir;
+    node->data = data;
+
+    if (crit_insert(&dir->children, node) != 1) {
+        free(node->name);
+        free(node);
+        return NULL;
+    }
+    dir->child_count++;
+    return node;
+}
+
+long path_list(PathNode *dir, const char *prefix, const char *after, long limit,
+               path_visit_fn fn, void *ctx, int *more) {
+    ListState st = { fn, ctx, limit, 0, 0, 0 };
+    size_t plen = prefix ? strlen(prefix) : 0;
+    void *top = dir->children;
+
+    if (more) {
+        *more = 0;
+    }
+    if (top == NULL) {
+        return 0;
+    }
+
+    // Every key below the first node testing a bit past the prefix shares
+    // the prefix, so checking one leaf decides the whole subtree.
+    while (IS_INTERNAL(top)) {
+        CritNode *q = TO_INTERNAL(top);
+        if (q->pos >= plen * 8) {
+            break;
+        }
+        top = q->child[key_bit(prefix, plen, q->pos)];
+    }
+    PathNode *sample = best_match(top, prefix ? prefix : "", plen);
+    if (sample->name_len < plen || memcmp(sample->name, prefix, plen) != 0) {
+        return 0;
+    }
+
+    if (after != NULL && after[0] != '\0') {
+        size_t alen = strlen(after);
+        PathNode *best = best_match(top, after, alen);
+        walk_after(top, after, alen, first_diff(after, alen, best->name, best->name_len), &st);
+    } else {
+        walk_all(top, &st);
+    }
+
+    if (more) {
+        *more = st.more;
+    }
+    return st.visited;
+}
+
+typedef struct {
+    path_visit_fn fn;
+    void *ctx;
+    int stop;
+} WalkState;
+
+static int walk_visit(PathNode *node, void *arg) {
+    WalkState *ws = arg;
+    if (ws->fn(node, ws->ctx)) {
+        ws->stop = 1;
+        return 1;
+    }
+    if (node->is_dir) {
+        path_list(node, NULL, NULL, -1, walk_visit, ws, NULL);
+    }
+    return ws->stop;
+}
+
+void path_walk(PathNode *dir, path_visit_fn fn, void *ctx) {
+    WalkState ws = { fn, ctx, 0 };
+    path_list(dir, NULL, NULL, -1, walk_visit, &ws, NULL);
+}
+
+int path_format(const PathNode *node, char *buf, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    if (node->parent == NULL) {
+        return snprintf(buf, size, "/");
+    }
+
+    // Fill from the end of the buffer towards the front, then shift down
+    size_t pos = size - 1;
+    buf[pos] = '\0';
+    for (const PathNode *n = node; n->parent != NULL; n = n->parent) {
+        if (n->name_len + 1 > pos) {
+            break; // truncated
+        }
+        pos -= n->name_len;
+        memcpy(buf + pos, n->name, n->name_len);
+        buf[--pos] = '/';
+    }
+    size_t len = size - 1 - pos;
+    memmove(buf, buf + pos, len + 1);
+    return (int)len;
+}
@@ -0,0 +1,57 @@
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <stddef.h>
+
+#define MAX_NAME_LEN 255   // longest single path component
+#define MAX_PATH_LEN 1024  // longest full path, including '\0'
+
+// One entry (file or directory) in the namespace. Children of a directory are
+// kept in a crit-bit (binary radix) tree keyed by name, so lookup and insert
+// cost O(name length) regardless of directory size, and entries come out in
+// sorted order for paginated listing.
+typedef struct PathNode {
+    char *name;              // component name, "" for the root
+    size_t name_len;
+    struct PathNode *parent; // NULL for the root
+    int is_dir;
+    void *data;              // caller's record for this entry
+    void *children;          // crit-bit tree of child entries (directories only)
+    long child_count;
+} PathNode;
+
+// Called for each listed entry; return non-zero to stop the walk.
+typedef int (*path_visit_fn)(PathNode *node, void *ctx);
+
+PathNode *path_new_root(void *data);
+
+// Resolve a '/'-separated path ("a/b", "/a/b" and "a//b/" are equivalent).
+// An empty path or "/" resolves to the root. Returns NULL if not found.
+PathNode *path_lookup(PathNode *root, const char *path);
+
+// Resolve the directory that would contain `path` and copy the last
+// component into `leaf`. Returns NULL if a parent is missing or is not a
+// directory, or if the path has no valid last component.
+PathNode *path_lookup_parent(PathNode *root, const char *path, char *leaf, size_t leaf_size);
+
+// Add `name` under directory `dir`. Returns the new node, or NULL if an entry
+// with that name already exists or allocation fails.
+PathNode *path_add_child(PathNode *dir, const char *name, int is_dir, void *data);
+
+// List children of `dir` in name order, restricted to names starting with
+// `prefix` (NULL or "" for all) and sorting strictly after `after` (NULL or ""
+// to start at the beginning). At most `limit` entries are visited (negative
+// for no limit); *more is set when further entries remain.
+long path_list(PathNode *dir, const char *prefix, const char *after, long limit,
+               path_visit_fn fn, void *ctx, int *more);
+
+// Visit every entry below `dir` depth-first, directories before their contents.
+void path_walk(PathNode *dir, path_visit_fn fn, void *ctx);
+
+// Write the absolute path of `node` into `buf`. Returns its length.
+int path_format(const PathNode *node, char *buf, size_t size);
+
+// Non-zero if `name` can be used as a path component.
+int path_valid_name(const char *name);
+
+#endif
@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "search.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_AVX2 1
+#endif
+
+// Written once under search_once and only read afterwards
+static const char *(*find)(const char *text, size_t len, const char *pattern, size_t plen);
+static const char *impl_name;
+static pthread_once_t search_once = PTHREAD_ONCE_INIT;
+
+static const char *find_scalar(const char *text, size_t len, const char *pattern, size_t plen) {
+    if (plen == 0) {
+        return text;
+    }
+    const char *end = text + len;
+    while ((size_t)(end - text) >= plen) {
+        const char *hit = memchr(text, pattern[0], end - text - plen + 1);
+        if (hit == NULL) {
+            return NULL;
+        }
+        if (memcmp(hit + 1, pattern + 1, plen - 1) == 0) {
+            return hit;
+        }
+        text = hit + 1;
+    }
+    return NULL;
+}
+
+#ifdef HAVE_X86_AVX2
+// Compare the pattern's first and last bytes against 32 positions at once
+// and only memcmp where both agree. Using two bytes far apart keeps false
+// candidates rare even in text with many repeats of the first byte.
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *text, size_t len, const char *pattern, size_t plen) {
+    if (plen == 0) {
+        return text;
+    }
+    if (plen > len) {
+        return NULL;
+    }
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[plen - 1]);
+    size_t i = 0;
+    // The last-byte load reaches plen - 1 bytes past i
+    for (; i + plen - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(text + i + plen - 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                              _mm256_cmpeq_epi8(block_last, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(text + i + bit + 1, pattern + 1, plen - 1) == 0) {
+                return text + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(text + i, len - i, pattern, plen);
+}
+#endif
+
+static void search_init(void) {
+    find = find_scalar;
+    impl_name = "memchr";
+#ifdef HAVE_X86_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find = find_avx2;
+        impl_name = "avx2";
+    }
+#endif
+}
+
+const char *find_substring(const char *text, size_t len, const char *pattern, size_t plen) {
+    pthread_once(&search_once, search_init);
+    return find(text, len, pattern, plen);
+}
+
+int next_matching_line(const char *text, size_t len, size_t pos, const char *pattern, size_t plen,
+                       size_t *start, size_t *end) {
+    if (pos >= len) {
+        return -1;
+    }
+    // Searching the whole rest of the text, rather than line by line, keeps
+    // the vector loop on long runs of non-matching lines
+    const char *hit = find_substring(text + pos, len - pos, pattern, plen);
+    if (hit == NULL) {
+        return -1;
+    }
+    const char *line = memrchr(text + pos, '\n', hit - (text + pos));
+    const char *newline = memchr(hit, '\n', text + len - hit);
+    *start = line != NULL ? (size_t)(line + 1 - text) : pos;
+    *end = newline != NULL ? (size_t)(newline - text) : len;
+    return 0;
+}
+
+const char *search_impl(void) {
+    pthread_once(&search_once, search_init);
+    return impl_name;
+}
@@ -0,0 +1,23 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+// Substring search for the grep and count commands. Uses AVX2 to test 32
+// candidate positions at a time when the CPU has it; otherwise memchr for
+// the first byte followed by memcmp.
+
+// First occurrence of `pattern` in `text`, or NULL. An empty pattern
+// matches at the start.
+const char *find_substring(const char *text, size_t len, const char *pattern, size_t plen);
+
+// Find the first line at or after `pos` that contains `pattern`; `pos` must
+// be the start of a line. Sets [*start, *end) to the line without its
+// newline and returns 0, or returns -1 when there are no more matches.
+int next_matching_line(const char *text, size_t len, size_t pos, const char *pattern, size_t plen,
+                       size_t *start, size_t *end);
+
+// Name of the implementation in use, for logs
+const char *search_impl(void);
+
+#endif
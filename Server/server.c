@@ -3,57 +3,90 @@
 #include <string.h>
 #include <pthread.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdatomic.h>
+#include <signal.h>
+#include <poll.h>
+#include "server.h"
+#include "trace.h"
+#include "transport.h"
+#include "crc32c.h"
+#include "search.h"
+#include "fairshare.h"
+#include "dataset.h"
 
-#define PORT 12500
-#define BUFFER_SIZE (512 * 1024)
-#define MAX_FILES 100
-#define MAX_USERS 20
-
-typedef struct {
-    char username[20];
-    char group[20];
-} User;
-
-typedef struct {
-    char filename[50];
-    char permissions[7]; // rw-r--r
-    char owner[20];
-    char group[20];
-    char content[BUFFER_SIZE];
-    int size;
-    char created_at[30];
-    pthread_rwlock_t lock; // read-write lock
-    pthread_mutex_t file_mutex; // mutex for file
-    pthread_cond_t file_cond; // condition variable used for synchronous waiting
-    int readers;    // number of current reading clients
-    int is_writing; // indicates if it's currently being written to (0: no, 1: yes)
-} File;
-
-File files[MAX_FILES];
 User users[MAX_USERS];
 int file_count = 0;
 int user_count = 0;
-pthread_mutex_t data_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Function prototypes
-void *handle_client(void *arg);
-int find_file(const char *filename);
-void add_user(const char *username, const char *group);
-int check_permission(const char *username, const File file, char op);
-const char* get_user_group(const char *username);
-void send_user_list(int client_socket);
-void show_capability_list();
-void cleanup_files();
-void initialize_large_file(); 
-
-int main() {
+pthread_mutex_t data_mutex = PTHREAD_MUTEX_INITIALIZER; // guards users and user_count
+const char *trace_path = DEFAULT_TRACE_PATH;
+int simulate_delay = 1; // sleep in read/write to make the concurrency rules observable
+
+PathNode *root_dir;
+pthread_rwlock_t ns_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+int main(int argc, char *argv[]) {
     int server_fd, client_socket;
     struct sockaddr_in address;
     int opt = 1;
-    int addrlen = sizeof(address);
+
+    const char *load_spec = NULL, *save_image = NULL, *map_image = NULL;
+    const char *socket_path = DEFAULT_SOCKET_PATH;
+
+    // -t: start with tracing on, -T <file>: where trace dumps go,
+    // -n: no simulated read/write delay (for load testing),
+    // -L <spec>: generate a synthetic dataset, -M <image>: map a saved one,
+    // -S <image>: save the namespace after loading,
+    // -U <path>: Unix socket for local clients ("" to disable),
+    // -G <group:weight[:ops/s[:bytes/s]]>: fair-share settings for a group (repeatable),
+    // -Q <n>: commands that may run at once
+    while ((opt = getopt(argc, argv, "tT:nL:M:S:U:G:Q:")) != -1) {
+        switch (opt) {
+        case 'G':
+            if (fair_configure(optarg) < 0) {
+                fprintf(stderr, "Invalid group setting '%s', expected group:weight[:ops_per_sec[:bytes_per_sec]]\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'Q':
+            if (atoi(optarg) < 1) {
+                fprintf(stderr, "Invalid slot count '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            fair_set_slots(atoi(optarg));
+            break;
+        case 'U':
+            socket_path = optarg;
+            break;
+        case 'L':
+            load_spec = optarg;
+            break;
+        case 'M':
+            map_image = optarg;
+            break;
+        case 'S':
+            save_image = optarg;
+            break;
+        case 'n':
+            simulate_delay = 0;
+            break;
+        case 't':
+            atomic_store(&trace_enabled, 1);
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n] [-t] [-T trace_file] [-L dataset_spec] [-M image] [-S image] [-U socket_path] [-G group:weight[:ops[:bytes]]] [-Q slots]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    opt = 1;
+
+    // SIGUSR1 dumps the trace buffers; must be set up before any thread starts
+    trace_dump_on_signal(SIGUSR1, trace_path);
 
     // Create socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
@@ -75,7 +108,9 @@ int main() {
         exit(EXIT_FAILURE);
     }
     
+    initialize_namespace();
     initialize_large_file();
+    load_dataset(load_spec, map_image, save_image);
 
     // Listen for clients
     if (listen(server_fd, 3) < 0) {
@@ -83,23 +118,46 @@ int main() {
         exit(EXIT_FAILURE);
     }
     printf("AȾҰʡAťݤf %d\n", PORT);
+    printf("Ƶ{GPɰ %d өRO\n", fair_slots());
+
+    // Co-located clients can skip loopback TCP
+    int local_fd = -1;
+    if (socket_path[0] != '\0' && (local_fd = open_local_listener(socket_path)) >= 0) {
+        printf("suG%s\n", socket_path);
+    }
 
     // Accept clients
+    struct pollfd listeners[2] = {
+        { server_fd, POLLIN, 0 },
+        { local_fd, POLLIN, 0 }, // ignored by poll while -1
+    };
     while (1) {
-        if ((client_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
-            perror("Ȥݥ");
-            exit(EXIT_FAILURE);
-        }
-        pthread_t thread_id;
-        int *pclient = malloc(sizeof(int));
-        if (pclient == NULL) {
-            perror("st");
-            close(client_socket);
+        if (poll(listeners, 2, -1) < 0) {
             continue;
         }
-        *pclient = client_socket;
-        pthread_create(&thread_id, NULL, handle_client, pclient);
-        pthread_detach(thread_id); // Detach thread to free resources
+        for (int i = 0; i < 2; i++) {
+            if (!(listeners[i].revents & POLLIN)) {
+                continue;
+            }
+            if ((client_socket = accept(listeners[i].fd, NULL, NULL)) < 0) {
+                perror("Ȥݥ");
+                continue;
+            }
+            if (i == 0) {
+                // Replies are often written in pieces (content, then end marker);
+                // don't let Nagle hold the last piece back for a delayed ACK
+                setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            }
+            pthread_t thread_id;
+            Conn *conn = conn_new(client_socket, i == 1);
+            if (conn == NULL) {
+                perror("st");
+                close(client_socket);
+                continue;
+            }
+            pthread_create(&thread_id, NULL, handle_client, conn);
+            pthread_detach(thread_id); // Detach thread to free resources
+        }
     }
 
     atexit(cleanup_files);
@@ -108,178 +166,206 @@ int main() {
 }
 
 void *handle_client(void *arg) {
-    int client_socket = *((int *)arg);
-    free(arg);
-    char buffer[BUFFER_SIZE];
+    Conn *conn = arg;
+    // Control commands and replies go through a small pooled buffer; a large
+    // one is only borrowed while file content is being transferred.
+    char *buffer = buf_acquire(BUF_SMALL);
+    size_t buffer_size = SMALL_BUFFER_SIZE;
+    if (buffer == NULL) {
+        conn_close(conn);
+        return NULL;
+    }
     char local_current_user[20] = ""; // The current user for each client
     char current_user[20] = "";
+    char current_group[20] = "";
     int expected = 0;
+    int in_command = 0;
+    FairTicket ticket = { NULL, 0 };
+    int scheduled = 0;
+    conn->fair = &ticket; // conn_read and conn_write give the slot back
+    unsigned long io_mark = 0; // connection bytes before the current command
 
     while (1) {
-        memset(buffer, 0, sizeof(buffer));
-        int read_size = read(client_socket, buffer, sizeof(buffer));
+        // Every command path, including those that 'continue', ends up here
+        if (scheduled) {
+            fair_end(&ticket, conn->bytes_in + conn->bytes_out - io_mark);
+            scheduled = 0;
+        }
+        if (in_command) {
+            TRACE_END("command", "command", 0);
+            in_command = 0;
+        }
+        int read_size = conn_read(conn, buffer, buffer_size - 1);
         if (read_size <= 0) {
             // Client disconnected
             printf("Ȥ_}sC\n");
             break;
         }
+        buffer[read_size] = '\0';
 
         // Define command parameters
-        char command[20], arg1[50], arg2[2], arg3[BUFFER_SIZE];
-        memset(command, 0, sizeof(command));
-        memset(arg1, 0, sizeof(arg1));
-        memset(arg2, 0, sizeof(arg2));
-        memset(arg3, 0, sizeof(arg3));
-        sscanf(buffer, "%s %s %s %[^\n]", command, arg1, arg2, arg3);
+        // arg1 is a path, arg2 permissions, o/a or an ls cursor name
+        char command[20], arg1[MAX_PATH_LEN], arg2[MAX_NAME_LEN + 1], arg3[256];
+        command[0] = arg1[0] = arg2[0] = arg3[0] = '\0';
+        sscanf(buffer, "%19s %1023s %255s %255[^\n]", command, arg1, arg2, arg3);
+        TRACE_BEGIN("command", "command", command);
+        in_command = 1;
+
+        // Wait for this group's fair share; stats, trace and transport always
+        // answer at once. The slot is held only until the command first
+        // sleeps or talks to its client, so a stalled client or a long
+        // transfer does not keep others waiting.
+        io_mark = conn->bytes_in + conn->bytes_out - read_size;
+        if (strcmp(command, "stats") != 0 && strcmp(command, "trace") != 0 &&
+            strcmp(command, "transport") != 0) {
+            TRACE_BEGIN("sched", "fair_queue", current_group);
+            fair_begin(&ticket, current_group);
+            TRACE_END("sched", "fair_queue", 0);
+            scheduled = 1;
+        }
     
-        //pthread_mutex_lock(&data_mutex);
 
         // Handle commands
         if (strcmp(command, "create_user") == 0) {
             // Create user
+            pthread_mutex_lock(&data_mutex);
             if (user_count < MAX_USERS) {
                 // Check if user already exists
                 int exists = 0;
                 for (int i = 0; i < user_count; i++) {
                     if (strcmp(users[i].username, arg1) == 0) {                    
                         exists = 1;
-                        //pthread_mutex_unlock(&data_mutex);
                         break;
                     }
                 }
                 if (exists) {
-                    snprintf(buffer, sizeof(buffer), "Τ %s wsbC\n", arg1);
-                    //pthread_mutex_unlock(&data_mutex);
+                    snprintf(buffer, buffer_size, "Τ %s wsbC\n", arg1);
                 } else {
                     add_user(arg1, arg2); // Create user based on username and group
-                    snprintf(buffer, sizeof(buffer), "User %s added to group %s.\n", arg1, arg2);
-                    //pthread_mutex_unlock(&data_mutex);
+                    snprintf(buffer, buffer_size, "User %s added to group %s.\n", arg1, arg2);
                 }
-               // pthread_mutex_unlock(&data_mutex);
             } else {
-                snprintf(buffer, sizeof(buffer), "ΤƶqwFWC\n");
-                //pthread_mutex_unlock(&data_mutex);
+                snprintf(buffer, buffer_size, "ΤƶqwFWC\n");
             }
-            //pthread_mutex_unlock(&data_mutex);
+            pthread_mutex_unlock(&data_mutex);
         } else if (strcmp(command, "list_users") == 0) {
             // List all users
-            send_user_list(client_socket);
-            //pthread_mutex_unlock(&data_mutex);
+            send_user_list(conn, buffer, buffer_size);
             continue; // Response already sent, skip subsequent code
         } else if (strcmp(command, "set_user") == 0) {
             // Check if user exists
             int exists = 0;
+            pthread_mutex_lock(&data_mutex);
             for (int i = 0; i < user_count; i++) {
                 if (strcmp(users[i].username, arg1) == 0) {
                     exists = 1;
                     strncpy(local_current_user, users[i].username, sizeof(local_current_user) - 1);
                     local_current_user[sizeof(local_current_user)-1] = '\0';
                     strncpy(current_user, local_current_user, sizeof(current_user) - 1); 
+                    strncpy(current_group, users[i].group, sizeof(current_group) - 1);
                     break;
                 }               
             }
+            pthread_mutex_unlock(&data_mutex);
             if (exists) {
                 
-                snprintf(buffer, sizeof(buffer), "User: %s (%s)\nAvailable commands:\n1. create <filename> <permissions>\n2. read <filename>\n3. write <filename> o/a\n4. mode <filename> <permissions>\n5. exit\n", 
+                snprintf(buffer, buffer_size, "User: %s (%s)\nAvailable commands:\n1. create <path> [permissions]\n2. read <path>\n3. write <path> o/a\n4. mode <path> <permissions>\n5. mkdir <path> [permissions]\n6. ls [path] [after]\n7. verify <path>\n8. grep <path> <pattern>\n9. count <path> <pattern>\n10. exit\n", 
                          local_current_user, get_user_group(local_current_user));  
                 show_capability_list();                  
             } else {
-                snprintf(buffer, sizeof(buffer), "Τ %s sbC\n", arg1);
+                snprintf(buffer, buffer_size, "Τ %s sbC\n", arg1);
             }
             
-        } else if (strcmp(command, "create") == 0) {
+        } else if (strcmp(command, "create") == 0 || strcmp(command, "mkdir") == 0) {
+            int is_dir = strcmp(command, "mkdir") == 0;
+            File *file = NULL;
         
             if (strlen(local_current_user) == 0) {
-                snprintf(buffer, sizeof(buffer), "]wΤCХnJC\n");
-            } else if (find_file(arg1) != -1) {
-                snprintf(buffer, sizeof(buffer), "ɮ '%s' wsbC\n", arg1);
-            }  else if (file_count < MAX_FILES) {
-                pthread_mutex_init(&files[file_count].file_mutex, NULL);
-        
-                // Create file
-                strncpy(files[file_count].filename, arg1, sizeof(files[file_count].filename) - 1);
-                files[file_count].filename[sizeof(files[file_count].filename) - 1] = '\0';            
-           
-                strncpy(files[file_count].permissions, arg2, sizeof(files[file_count].permissions) - 1);
-                files[file_count].permissions[sizeof(files[file_count].permissions) - 1] = '\0';           
-
-                // Set owner
-                strncpy(files[file_count].owner, current_user, sizeof(files[file_count].owner) - 1);
-                files[file_count].owner[sizeof(files[file_count].owner) - 1] = '\0';
-        
-                // Initialize read-write lock
-                pthread_rwlock_init(&files[file_count].lock, NULL);        
-
-                // Ensure the group is valid
-                const char *user_group = get_user_group(current_user);
-        
-                // Set group
-                strncpy(files[file_count].group, user_group, sizeof(files[file_count].group) - 1);
-                files[file_count].group[sizeof(files[file_count].group) - 1] = '\0';
-
-                files[file_count].size = 0;
-                files[file_count].content[0] = '\0';  // Initialize content 
-
-                // Record creation time
-                time_t now = time(NULL);
-                strftime(files[file_count].created_at, sizeof(files[file_count].created_at), "%Y-%m-%d %H:%M:%S", localtime(&now));
-                file_count++;
-
-                // Display created file details
-                snprintf(buffer, sizeof(buffer), "File '%s' CreatedAPermissions %sAOwnerG%sAGroupG%sC\n", 
-                         arg1, arg2, files[file_count-1].owner, files[file_count-1].group);  
-                show_capability_list(); // Show capability list
+                snprintf(buffer, buffer_size, "]wΤCХnJC\n");
             } else {
-                snprintf(buffer, sizeof(buffer), "The number of files has reached the upper limit.\n");
+                // Without explicit permissions the entry inherits its directory's
+                switch (create_entry(current_user, arg1, arg2[0] ? arg2 : NULL, is_dir, &file)) {
+                case CREATE_OK: {
+                    char permissions[7];
+                    get_permissions(file, permissions);
+                    // Display created file details
+                    snprintf(buffer, buffer_size, "%s '%s' CreatedAPermissions %sAOwnerG%sAGroupG%sC\n", 
+                             is_dir ? "Directory" : "File", arg1, permissions, file->owner, file->group);  
+                    show_capability_list(); // Show capability list
+                    break;
+                }
+                case CREATE_EXISTS:
+                    snprintf(buffer, buffer_size, "ɮ '%s' wsbC\n", arg1);
+                    break;
+                case CREATE_NO_PARENT:
+                    snprintf(buffer, buffer_size, "Invalid path or parent directory not found: '%s'.\n", arg1);
+                    break;
+                case CREATE_DENIED:
+                    snprintf(buffer, buffer_size, "Permissions denied.\n");
+                    break;
+                default:
+                    snprintf(buffer, buffer_size, "The number of files has reached the upper limit.\n");
+                    break;
+                }
             }
          
+        } else if (strcmp(command, "ls") == 0) {
+            if (strlen(current_user) == 0) {
+                snprintf(buffer, buffer_size, "No user has been configured. Please log in first.\n<END_OF_FILE>\n");
+            } else {
+                list_directory(conn, current_user, arg1, arg2);
+                continue; // Response already sent
+            }
         } else if (strcmp(command, "read") == 0) {
             if (strlen(current_user) == 0) {
-                snprintf(buffer, sizeof(buffer), "No user has been configured. Please log in first.\n<END_OF_FILE>");
+                snprintf(buffer, buffer_size, "No user has been configured. Please log in first.\n<END_OF_FILE>");
             }
             else {
                 // File read
-                int index = find_file(arg1);
-                if (index == -1) {
-                    snprintf(buffer, sizeof(buffer), "File not found.\n<END_OF_FILE>");
-                } else if (!check_permission(current_user, files[index], 'r')) {
-                    snprintf(buffer, sizeof(buffer), "Permissions denied\n<END_OF_FILE>");
+                File *file = find_file(arg1);
+                if (file == NULL) {
+                    snprintf(buffer, buffer_size, "File not found.\n<END_OF_FILE>");
+                } else if (file->is_dir) {
+                    snprintf(buffer, buffer_size, "'%s' is a directory.\n<END_OF_FILE>", arg1);
+                } else if (!check_permission(current_user, file, 'r')) {
+                    snprintf(buffer, buffer_size, "Permissions denied\n<END_OF_FILE>");
                 } else {
-                    pthread_mutex_lock(&files[index].file_mutex);                    
-                    if (files[index].is_writing){         
-                        snprintf(buffer, sizeof(buffer), "ɮ '%s' bQLϥΪ̼gJALkŪC\n<END_OF_FILE>", arg1);
-                        pthread_mutex_unlock(&files[index].file_mutex);                     
+                    traced_mutex_lock(&file->file_mutex, "file_mutex");                    
+                    if (file->is_writing){         
+                        snprintf(buffer, buffer_size, "ɮ '%s' bQLϥΪ̼gJALkŪC\n<END_OF_FILE>", arg1);
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");                     
                     } else{
                         
-                        files[index].readers++;
-                        pthread_mutex_unlock(&files[index].file_mutex);
+                        file->readers++;
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
 
                         // Acquire read lock and perform reading
-                        pthread_rwlock_rdlock(&files[index].lock);
+                        traced_rdlock(&file->lock, "file_rwlock");
                         printf("reading...\n");
-                        sleep(2); // Simulate read delay
-                        int content_len = strlen(files[index].content);
+                        if (simulate_delay) {
+                            fair_yield(&ticket);
+                            sleep(2); // Simulate read delay
+                        }
+                        int content_len = file->size;
                         int sent = 0;
-                        // Send file content in segments
+                        // Send file content straight from the file, no staging copy
                         while (sent < content_len) {
-                            int chunk_size = content_len - sent;
-                            if (chunk_size > (int)(sizeof(buffer) - 1)) {
-                                chunk_size = (int)(sizeof(buffer) - 1);
+                            int n = conn_write(conn, file->content + sent, content_len - sent);
+                            if (n <= 0) {
+                                break;
                             }
-                            memcpy(buffer, files[index].content + sent, chunk_size);
-                            buffer[chunk_size] = '\0';
-                            write(client_socket, buffer, chunk_size);
-                            sent += chunk_size;
+                            sent += n;
                         }
                 
-                        // Send end marker
-                        const char *end_marker = "\n<END_OF_FILE>\n";
-                        write(client_socket, end_marker, strlen(end_marker));
-                        pthread_rwlock_unlock(&files[index].lock);
-
-                        pthread_mutex_lock(&files[index].file_mutex);
-                        files[index].readers--;
-                        pthread_mutex_unlock(&files[index].file_mutex);
+                        // Send end marker, followed by the checksums of what was sent
+                        int len = format_checksums(file, buffer, buffer_size);
+                        conn_write(conn, buffer, len);
+                        traced_rwunlock(&file->lock, "file_rwlock");
+
+                        traced_mutex_lock(&file->file_mutex, "file_mutex");
+                        file->readers--;
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
+                        continue; // Response already sent
                     }                
                 }
             }
@@ -288,63 +374,108 @@ void *handle_client(void *arg) {
         
         else if (strcmp(command, "write") == 0) {        
             if (strlen(current_user) == 0) {
-                snprintf(buffer, sizeof(buffer), "No user has been configured. Please log in first.\n");
+                snprintf(buffer, buffer_size, "No user has been configured. Please log in first.\n");
             } else {
-                int index = find_file(arg1);                
-                if (index == -1) {
-                    snprintf(buffer, sizeof(buffer), "File not found.\n");
-                } else if (!check_permission(current_user, files[index], 'w')) {
-                    snprintf(buffer, sizeof(buffer), "Permissions denied.\n");
+                File *file = find_file(arg1);                
+                if (file == NULL) {
+                    snprintf(buffer, buffer_size, "File not found.\n");
+                } else if (file->is_dir) {
+                    snprintf(buffer, buffer_size, "'%s' is a directory.\n", arg1);
+                } else if (!check_permission(current_user, file, 'w')) {
+                    snprintf(buffer, buffer_size, "Permissions denied.\n");
                 } else {           
-                    pthread_mutex_lock(&files[index].file_mutex);
-                    if (files[index].is_writing || files[index].readers > 0) {                
-                        snprintf(buffer, sizeof(buffer), "ɮ '%s' bQLϥΪ̾ާ@ALkgJC\n", arg1);
-                        pthread_mutex_unlock(&files[index].file_mutex);               
+                    traced_mutex_lock(&file->file_mutex, "file_mutex");
+                    if (file->is_writing || file->readers > 0) {                
+                        snprintf(buffer, buffer_size, "ɮ '%s' bQLϥΪ̾ާ@ALkgJC\n", arg1);
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");               
                     }else{                            
-                        // Mark as being written
-                        files[index].is_writing = 1;
-                        pthread_mutex_unlock(&files[index].file_mutex);
+                        // Mark as being written. The write was admitted before
+                        // this, so a file is never marked while its writer queues.
+                        file->is_writing = 1;
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
 
                         // Notify the client to send content
-                        snprintf(buffer, sizeof(buffer), "Ready to write to file '%s'. Send content.\n", arg1);
-                        write(client_socket, buffer, strlen(buffer));
+                        snprintf(buffer, buffer_size, "Ready to write to file '%s'. Send content.\n", arg1);
+                        conn_write(conn, buffer, strlen(buffer));
 
-                        // Wait for the client to send content
-                        memset(buffer, 0, sizeof(buffer));
-                        int read_size = read(client_socket, buffer, sizeof(buffer));
+                        // Wait for the client to send content. With "crc" the upload
+                        // starts with "<length> <crc32c>\n", so it can be read whole
+                        // and checked instead of trusting a single read
+                        char *data = buf_acquire(BUF_LARGE);
+                        char *content = data;
+                        int read_size, content_len = 0, checked = strcmp(arg3, "crc") == 0;
+                        char error[128] = "";
+                        if (data == NULL) {
+                            read_size = -1;
+                        } else if (checked) {
+                            read_size = receive_checked(conn, data, LARGE_BUFFER_SIZE, &content, &content_len, error, sizeof(error));
+                        } else {
+                            read_size = conn_read(conn, data, LARGE_BUFFER_SIZE - 1);
+                            if (read_size > 0) {
+                                data[read_size] = '\0';
+                                content_len = strlen(data);
+                            }
+                        }
                         if (read_size <= 0) {
                             // If the client disconnects, reset writing status
-                            pthread_mutex_lock(&files[index].file_mutex);
-                            files[index].is_writing = 0;
-                            pthread_mutex_unlock(&files[index].file_mutex);
+                            traced_mutex_lock(&file->file_mutex, "file_mutex");
+                            file->is_writing = 0;
+                            traced_mutex_unlock(&file->file_mutex, "file_mutex");
                             printf("Client disconnected before sending content.\n");
+                            fair_end(&ticket, conn->bytes_in + conn->bytes_out - io_mark);
+                            buf_release(data);
+                            buf_release(buffer);
+                            conn_close(conn);
                             return NULL;
                         }
+                        if (error[0] != '\0') {
+                            traced_mutex_lock(&file->file_mutex, "file_mutex");
+                            file->is_writing = 0;
+                            traced_mutex_unlock(&file->file_mutex, "file_mutex");
+                            buf_release(data);
+                            snprintf(buffer, buffer_size, "Write to file '%s' failed: %s.\n", arg1, error);
+                            conn_write(conn, buffer, strlen(buffer));
+                            continue;
+                        }
 
                         // Acquire write lock and perform writing
-                        pthread_rwlock_wrlock(&files[index].lock);
+                        traced_wrlock(&file->lock, "file_rwlock");
 
                         printf("Writing to file '%s'...\n", arg1);
-                        sleep(3); // Simulate write delay
+                        if (simulate_delay) {
+                            fair_yield(&ticket);
+                            sleep(3); // Simulate write delay
+                        }
+                        int stored = 0;
                         if (strcmp(arg2, "o") == 0) {
-                            strncpy(files[index].content, buffer, sizeof(files[index].content) - 1);
-                            files[index].content[sizeof(files[index].content) - 1] = '\0';
-                            files[index].size = strlen(files[index].content);
+                            stored = store_content(file, content, content_len, 0);
                         } else if (strcmp(arg2, "a") == 0) {
-                            strncat(files[index].content, buffer, sizeof(files[index].content) - strlen(files[index].content) - 1);
-                            files[index].size += strlen(buffer);
+                            stored = store_content(file, content, content_len, 1);
                         }
 
-                        pthread_rwlock_unlock(&files[index].lock);
+                        traced_rwunlock(&file->lock, "file_rwlock");
+                        buf_release(data);
 
                         // Release writing status
-                        pthread_mutex_lock(&files[index].file_mutex);
-                        files[index].is_writing = 0;
-                        pthread_mutex_unlock(&files[index].file_mutex);
+                        traced_mutex_lock(&file->file_mutex, "file_mutex");
+                        file->is_writing = 0;
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
 
-                        snprintf(buffer, sizeof(buffer), "Write to file '%s' completed.\n", arg1);
-                        write(client_socket, buffer, strlen(buffer));
+                        if (stored < 0) {
+                            // The file keeps its old content
+                            if (stored == -2) {
+                                snprintf(buffer, buffer_size, "Write to file '%s' failed: file would exceed %d bytes.\n",
+                                         arg1, BUFFER_SIZE - 1);
+                            } else {
+                                snprintf(buffer, buffer_size, "Write to file '%s' failed: out of memory.\n", arg1);
+                            }
+                            conn_write(conn, buffer, strlen(buffer));
+                            continue;
+                        }
+                        snprintf(buffer, buffer_size, "Write to file '%s' completed.\n", arg1);
+                        conn_write(conn, buffer, strlen(buffer));
                         show_capability_list(); // Show capability list
+                        continue; // Response already sent
                     }
                 }
             }
@@ -353,32 +484,127 @@ void *handle_client(void *arg) {
 
         else if (strcmp(command, "mode") == 0) {
             if (strlen(current_user) == 0) {
-                snprintf(buffer, sizeof(buffer), "No user has been configured. Please log in first.\n");
+                snprintf(buffer, buffer_size, "No user has been configured. Please log in first.\n");
             }
             else {
                 // Modify file permissions
-                int index = find_file(arg1);
-                if (index == -1) {
-                    snprintf(buffer, sizeof(buffer), "File not found.\n");
-                } else if (strcmp(files[index].owner, current_user) != 0) {
+                File *file = find_file(arg1);
+                if (file == NULL) {
+                    snprintf(buffer, buffer_size, "File not found.\n");
+                } else if (strcmp(file->owner, current_user) != 0) {
                     // Only the file owner can change permissions.
-                    snprintf(buffer, sizeof(buffer), "ɮ׾֦̥iHvC\n");
+                    snprintf(buffer, buffer_size, "ɮ׾֦̥iHvC\n");
                 } else {
-                    strncpy(files[index].permissions, arg2, sizeof(files[index].permissions) - 1);
-                    files[index].permissions[sizeof(files[index].permissions)-1] = '\0';
-                    snprintf(buffer, sizeof(buffer), "ɮ %s vws %sC\n", arg1, arg2);
+                    traced_mutex_lock(&file->file_mutex, "file_mutex");
+                    strncpy(file->permissions, arg2, sizeof(file->permissions) - 1);
+                    file->permissions[sizeof(file->permissions)-1] = '\0';
+                    traced_mutex_unlock(&file->file_mutex, "file_mutex");
+                    snprintf(buffer, buffer_size, "ɮ %s vws %sC\n", arg1, arg2);
                     show_capability_list(); // Show capability list
                 }
             }
            
         }        
+        else if (strcmp(command, "trace") == 0) {
+            // trace on|off|dump; dumps go to the file given with -T
+            if (strcmp(arg1, "on") == 0 || strcmp(arg1, "off") == 0) {
+                atomic_store(&trace_enabled, strcmp(arg1, "on") == 0);
+                snprintf(buffer, buffer_size, "Tracing %s.\n", arg1);
+            } else if (strcmp(arg1, "dump") == 0) {
+                long n = trace_dump(trace_path);
+                if (n < 0) {
+                    snprintf(buffer, buffer_size, "Cannot write trace to '%s'.\n", trace_path);
+                } else {
+                    snprintf(buffer, buffer_size, "Trace: %ld events written to %s\n", n, trace_path);
+                }
+            } else {
+                snprintf(buffer, buffer_size, "Usage: trace on|off|dump\n");
+            }
+        }
+        else if (strcmp(command, "verify") == 0) {
+            if (strlen(current_user) == 0) {
+                snprintf(buffer, buffer_size, "No user has been configured. Please log in first.\n");
+            } else {
+                File *file = find_file(arg1);
+                if (file == NULL) {
+                    snprintf(buffer, buffer_size, "File not found.\n");
+                } else if (file->is_dir) {
+                    snprintf(buffer, buffer_size, "'%s' is a directory.\n", arg1);
+                } else if (!check_permission(current_user, file, 'r')) {
+                    snprintf(buffer, buffer_size, "Permissions denied.\n");
+                } else {
+                    traced_rdlock(&file->lock, "file_rwlock");
+                    verify_content(file, arg1, buffer, buffer_size);
+                    traced_rwunlock(&file->lock, "file_rwlock");
+                }
+            }
+        }
+        else if (strcmp(command, "grep") == 0 || strcmp(command, "count") == 0) {
+            // grep streams the matching lines like a read, count answers with
+            // one line; both end grep-style replies with the end marker
+            int count_only = strcmp(command, "count") == 0;
+            const char *end = count_only ? "" : "<END_OF_FILE>\n";
+            char pattern[SEARCH_PATTERN_MAX + 1];
+            command_tail(buffer, 2, pattern, sizeof(pattern));
+            if (strlen(current_user) == 0) {
+                snprintf(buffer, buffer_size, "No user has been configured. Please log in first.\n%s", end);
+            } else if (arg1[0] == '\0' || pattern[0] == '\0') {
+                snprintf(buffer, buffer_size, "Usage: %s <path> <pattern>\n%s", command, end);
+            } else {
+                File *file = find_file(arg1);
+                if (file == NULL) {
+                    snprintf(buffer, buffer_size, "File not found.\n%s", end);
+                } else if (file->is_dir) {
+                    snprintf(buffer, buffer_size, "'%s' is a directory.\n%s", arg1, end);
+                } else if (!check_permission(current_user, file, 'r')) {
+                    snprintf(buffer, buffer_size, "Permissions denied.\n%s", end);
+                } else {
+                    traced_mutex_lock(&file->file_mutex, "file_mutex");
+                    if (file->is_writing) {
+                        snprintf(buffer, buffer_size, "ɮ '%s' bQLϥΪ̼gJALkjMC\n%s", arg1, end);
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
+                    } else {
+                        file->readers++;
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
+
+                        traced_rdlock(&file->lock, "file_rwlock");
+                        long matches = search_content(count_only ? NULL : conn, file, pattern, buffer, buffer_size);
+                        traced_rwunlock(&file->lock, "file_rwlock");
+
+                        traced_mutex_lock(&file->file_mutex, "file_mutex");
+                        file->readers--;
+                        traced_mutex_unlock(&file->file_mutex, "file_mutex");
+                        if (count_only) {
+                            snprintf(buffer, buffer_size, "Count: %ld lines of '%s' contain '%s' (%s).\n",
+                                     matches, arg1, pattern, search_impl());
+                        } else {
+                            snprintf(buffer, buffer_size, "<END_OF_FILE> matches=%ld\n", matches);
+                        }
+                    }
+                }
+            }
+        }
+        else if (strcmp(command, "stats") == 0) {
+            fair_stats(buffer, buffer_size);
+        }
+        else if (strcmp(command, "transport") == 0) {
+            // Local clients may move to shared memory; the reply, with the
+            // ring descriptors attached, goes out on the socket
+            if (strcmp(arg1, "shm") == 0 && conn_use_shm(conn) == 0) {
+                continue;
+            }
+            snprintf(buffer, buffer_size, "Transport: stream\n");
+        }
         else {
-            snprintf(buffer, sizeof(buffer), "Invaild commandC\n");
+            snprintf(buffer, buffer_size, "Invaild commandC\n");
         }
-        //pthread_mutex_unlock(&data_mutex);
-        write(client_socket, buffer, strlen(buffer));
+        conn_write(conn, buffer, strlen(buffer));
        
     }
+
+    buf_release(buffer);
+    conn_close(conn);
+    return NULL;
 }
 
 // Define all helper functions globally
@@ -400,138 +626,551 @@ void add_user(const char *username, const char *group) {
     user_count++;
 }
 
-int find_file(const char *filename) {
-    for (int i = 0; i < file_count; i++) {
-        if (strcmp(files[i].filename, filename) == 0) {
-            return i;
+File *find_file(const char *path) {
+    traced_rdlock(&ns_lock, "ns_lock");
+    PathNode *node = path_lookup(root_dir, path);
+    traced_rwunlock(&ns_lock, "ns_lock");
+    return node ? node->data : NULL;
+}
+
+File *new_file(const char *permissions, const char *owner, const char *group, int is_dir, const char *created_at) {
+    File *file = calloc(1, sizeof(File));
+    if (file == NULL) {
+        return NULL;
+    }
+    file->is_dir = is_dir;
+
+    strncpy(file->permissions, permissions, sizeof(file->permissions) - 1);
+    file->permissions[sizeof(file->permissions) - 1] = '\0';
+
+    // Set owner and group
+    strncpy(file->owner, owner, sizeof(file->owner) - 1);
+    file->owner[sizeof(file->owner) - 1] = '\0';
+    strncpy(file->group, group, sizeof(file->group) - 1);
+    file->group[sizeof(file->group) - 1] = '\0';
+
+    // Record creation time, unless the caller already formatted one
+    if (created_at != NULL) {
+        strncpy(file->created_at, created_at, sizeof(file->created_at) - 1);
+    } else {
+        time_t now = time(NULL);
+        struct tm tm;
+        strftime(file->created_at, sizeof(file->created_at), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm));
+    }
+
+    // Initialize locks
+    pthread_rwlock_init(&file->lock, NULL);
+    pthread_mutex_init(&file->file_mutex, NULL);
+    pthread_cond_init(&file->file_cond, NULL);
+    return file;
+}
+
+int create_entry(const char *username, const char *path, const char *permissions, int is_dir, File **out) {
+    char name[MAX_NAME_LEN + 1];
+    int status = CREATE_OK;
+
+    // Lookup, permission check and insert happen under one write lock so two
+    // clients racing on the same path cannot both succeed
+    traced_wrlock(&ns_lock, "ns_lock");
+    PathNode *dir = path_lookup_parent(root_dir, path, name, sizeof(name));
+    if (dir == NULL) {
+        status = CREATE_NO_PARENT;
+    } else if (!check_permission(username, dir->data, 'w')) {
+        status = CREATE_DENIED;
+    } else if (path_lookup(dir, name) != NULL) {
+        status = CREATE_EXISTS;
+    } else {
+        char inherited[7];
+        get_permissions(dir->data, inherited);
+        File *file = new_file(permissions ? permissions : inherited,
+                              username, get_user_group(username), is_dir, NULL);
+        if (file == NULL) {
+            status = CREATE_NO_MEMORY;
+        } else if ((file->node = path_add_child(dir, name, is_dir, file)) == NULL) {
+            free(file);
+            status = CREATE_NO_MEMORY;
+        } else {
+            file_count++;
+            *out = file;
+        }
+    }
+    traced_rwunlock(&ns_lock, "ns_lock");
+    return status;
+}
+
+// Replace or append to a file's content, growing the buffer as needed.
+// Returns 0, -1 if memory ran out, or -2 if the result would be longer than
+// BUFFER_SIZE - 1 bytes; on failure the content is unchanged. Caller holds
+// the write lock.
+int store_content(File *file, const char *data, int len, int append) {
+    int offset = append ? file->size : 0;
+    if (offset + len > BUFFER_SIZE - 1) {
+        return -2;
+    }
+    if (offset + len + 1 > file->capacity) {
+        int capacity = file->capacity ? file->capacity : 64;
+        while (capacity < offset + len + 1) {
+            capacity *= 2;
+        }
+        // Image-backed content is read-only: copy it out instead of growing it
+        char *content = file->capacity ? realloc(file->content, capacity) : malloc(capacity);
+        if (content == NULL) {
+            return -1;
+        }
+        if (file->capacity == 0 && offset > 0) {
+            memcpy(content, file->content, offset);
+        }
+        file->content = content;
+        file->capacity = capacity;
+    }
+    memcpy(file->content + offset, data, len);
+    file->size = offset + len;
+    file->content[file->size] = '\0';
+    update_checksums(file, offset);
+    return 0;
+}
+
+// Recompute the checksums of every chunk from the one holding byte `from`
+// to the end of the content. Caller holds the write lock (or owns the file).
+void update_checksums(File *file, int from) {
+    int size = file->size;
+    for (int chunk = from / CHECKSUM_CHUNK; chunk * CHECKSUM_CHUNK < size; chunk++) {
+        int start = chunk * CHECKSUM_CHUNK;
+        int len = size - start < CHECKSUM_CHUNK ? size - start : CHECKSUM_CHUNK;
+        file->chunk_crc[chunk] = crc32c(0, file->content + start, len);
+    }
+}
+
+// End of a read reply: "\n<END_OF_FILE> crc32c size=<n> chunk=<bytes> sums=<hex>,...\n"
+int format_checksums(File *file, char *out, size_t size) {
+    int content_size = file->size;
+    int len = snprintf(out, size, "\n<END_OF_FILE> crc32c size=%d chunk=%d sums=", content_size, CHECKSUM_CHUNK);
+    for (int chunk = 0; chunk * CHECKSUM_CHUNK < content_size; chunk++) {
+        len += snprintf(out + len, size - len, "%s%08x", chunk ? "," : "", file->chunk_crc[chunk]);
+    }
+    len += snprintf(out + len, size - len, "\n");
+    return len;
+}
+
+// Recompute the content's checksums and compare them with the stored ones.
+// Caller holds the read lock.
+void verify_content(File *file, const char *path, char *out, size_t size) {
+    int content_size = file->size;
+    int chunks = 0;
+    uint32_t whole = 0;
+    for (int start = 0; start < content_size; start += CHECKSUM_CHUNK, chunks++) {
+        int len = content_size - start < CHECKSUM_CHUNK ? content_size - start : CHECKSUM_CHUNK;
+        uint32_t computed = crc32c(0, file->content + start, len);
+        if (computed != file->chunk_crc[chunks]) {
+            snprintf(out, size, "Verify '%s': chunk %d is corrupt (stored %08x, computed %08x).\n",
+                     path, chunks, file->chunk_crc[chunks], computed);
+            return;
+        }
+        whole = crc32c(whole, file->content + start, len);
+    }
+    snprintf(out, size, "Verify '%s': OK, %d bytes in %d chunks, crc32c %08x (%s).\n",
+             path, content_size, chunks, whole, crc32c_impl());
+}
+
+// Copy what follows the first `words` words of a command line and the one
+// space after them, without the line ending. Further spaces belong to the
+// tail, so "grep f  x" searches for " x".
+void command_tail(const char *line, int words, char *out, size_t size) {
+    for (int i = 0; i < words; i++) {
+        line += strspn(line, " ");
+        line += strcspn(line, " \r\n");
+    }
+    if (*line == ' ') {
+        line++;
+    }
+    snprintf(out, size, "%.*s", (int)strcspn(line, "\r\n"), line);
+}
+
+// Find the lines of the content that contain `pattern` and return how many
+// there are. With a connection, each one is also sent as
+// "<offset>:<length>:<line>\n", batched through `out`; the length lets the
+// client take a line holding "<END_OF_FILE>" as data. The caller sends the
+// end marker. Caller holds the read lock.
+long search_content(Conn *conn, File *file, const char *pattern, char *out, size_t size) {
+    const char *content = file->content;
+    size_t content_size = file->size, plen = strlen(pattern);
+    size_t pos = 0, start, end, used = 0;
+    long matches = 0;
+    while (next_matching_line(content, content_size, pos, pattern, plen, &start, &end) == 0) {
+        matches++;
+        pos = end + 1;
+        if (conn == NULL) {
+            continue;
+        }
+        size_t line_len = end - start;
+        if (used + line_len + 48 > size) { // room for two numbers and the newline
+            if (used > 0 && conn_write(conn, out, used) <= 0) {
+                break;
+            }
+            used = 0;
+        }
+        used += snprintf(out + used, size - used, "%zu:%zu:", start, line_len);
+        if (line_len + 1 > size - used) {
+            // Longer than the buffer: send it straight from the file
+            if (conn_write(conn, out, used) <= 0 || conn_write(conn, content + start, line_len) <= 0) {
+                break;
+            }
+            out[0] = '\n';
+            used = 1;
+            continue;
+        }
+        memcpy(out + used, content + start, line_len);
+        used += line_len;
+        out[used++] = '\n';
+    }
+    if (used > 0) {
+        conn_write(conn, out, used);
+    }
+    return matches;
+}
+
+// Read a checked upload: "<length> <crc32c>\n" then exactly <length> bytes.
+// Returns the bytes received (0 or less if the client went away); problems
+// with the upload itself are described in `error`.
+int receive_checked(Conn *conn, char *data, int capacity, char **content, int *content_len,
+                    char *error, size_t error_size) {
+    int received = 0, header_len = 0, expected = -1;
+    unsigned int crc = 0;
+
+    while (header_len == 0) {
+        int n = conn_read(conn, data + received, capacity - 1 - received);
+        if (n <= 0) {
+            return n;
+        }
+        received += n;
+        char *newline = memchr(data, '\n', received);
+        if (newline != NULL) {
+            header_len = newline - data + 1;
+        } else if (received >= 32) {
+            break;
+        }
+    }
+    data[received] = '\0';
+    if (header_len == 0 || sscanf(data, "%d %x", &expected, &crc) != 2 || expected < 0) {
+        snprintf(error, error_size, "bad upload header");
+        return received;
+    }
+
+    if (expected > capacity - 1 - header_len) {
+        // Too big to keep: drain it so the next command is read correctly
+        long left = (long)header_len + expected - received;
+        while (left > 0) {
+            int n = conn_read(conn, data, left < capacity - 1 ? left : capacity - 1);
+            if (n <= 0) {
+                return n;
+            }
+            left -= n;
+        }
+        snprintf(error, error_size, "upload larger than %d bytes", capacity - 1 - header_len);
+        return received;
+    }
+    while (received < header_len + expected) {
+        int n = conn_read(conn, data + received, header_len + expected - received);
+        if (n <= 0) {
+            return n;
         }
+        received += n;
     }
-    return -1;
+
+    *content = data + header_len;
+    *content_len = expected;
+    uint32_t computed = crc32c(0, *content, expected);
+    if (computed != crc) {
+        snprintf(error, error_size, "checksum mismatch (expected %08x, received %08x)", crc, computed);
+    }
+    return received;
+}
+
+typedef struct {
+    char *out;
+    size_t size;
+    size_t len;
+    const char *last; // name of the last entry listed, for the next page
+} ListBuffer;
+
+static int format_entry(PathNode *node, void *arg) {
+    ListBuffer *lb = arg;
+    File *file = node->data;
+    char permissions[7];
+    get_permissions(file, permissions);
+    lb->len += snprintf(lb->out + lb->len, lb->size - lb->len, "%s  %s  %s  %d  %s  %s%s\n",
+                        permissions, file->owner, file->group, file->size,
+                        file->created_at, node->name, node->is_dir ? "/" : "");
+    lb->last = node->name;
+    return 0;
 }
 
-int check_permission(const char *username, const File file, char op) {
+// ls [dir] [after]: one page of a directory in name order. A trailing '*'
+// on the last component ("logs/2024-*") lists only names with that prefix.
+// Replies end with <END_OF_FILE> like read.
+void list_directory(Conn *conn, const char *username, const char *path, const char *after) {
+    char dir_path[MAX_PATH_LEN];
+    char prefix_buf[MAX_PATH_LEN];
+    const char *prefix = NULL;
+    // Sized to one page, a tenth of a large pool buffer
+    char *out = malloc(LS_REPLY_SIZE);
+    int len;
+
+    if (out == NULL) {
+        const char *reply = "Out of memory.\n<END_OF_FILE>\n";
+        conn_write(conn, reply, strlen(reply));
+        return;
+    }
+    strncpy(dir_path, path, sizeof(dir_path) - 1);
+    dir_path[sizeof(dir_path) - 1] = '\0';
+    size_t plen = strlen(dir_path);
+    if (plen > 0 && dir_path[plen - 1] == '*') {
+        dir_path[plen - 1] = '\0';
+        char *slash = strrchr(dir_path, '/');
+        strcpy(prefix_buf, slash ? slash + 1 : dir_path);
+        if (slash) {
+            *slash = '\0';
+        } else {
+            dir_path[0] = '\0';
+        }
+        prefix = prefix_buf;
+    }
+
+    traced_rdlock(&ns_lock, "ns_lock");
+    PathNode *dir = path_lookup(root_dir, dir_path);
+    if (dir == NULL) {
+        len = snprintf(out, LS_REPLY_SIZE, "Directory not found.\n");
+    } else if (!dir->is_dir) {
+        len = snprintf(out, LS_REPLY_SIZE, "'%s' is not a directory.\n", path);
+    } else if (!check_permission(username, dir->data, 'r')) {
+        len = snprintf(out, LS_REPLY_SIZE, "Permissions denied.\n");
+    } else {
+        ListBuffer lb = { out, LS_REPLY_SIZE, 0, NULL };
+        int more = 0;
+        // Counting the names that match a prefix would mean visiting all of
+        // them for every page, so only a plain listing shows a total
+        if (prefix != NULL) {
+            lb.len = snprintf(out, lb.size, "=== %s ===\n", path);
+        } else {
+            lb.len = snprintf(out, lb.size, "=== %s (%ld entries) ===\n", path[0] ? path : "/", dir->child_count);
+        }
+        path_list(dir, prefix, after, LS_PAGE_SIZE, format_entry, &lb, &more);
+        if (more) {
+            lb.len += snprintf(out + lb.len, lb.size - lb.len, "-- more: ls %s %s --\n", path[0] ? path : "/", lb.last);
+        }
+        len = lb.len;
+    }
+    traced_rwunlock(&ns_lock, "ns_lock");
+
+    len += snprintf(out + len, LS_REPLY_SIZE - len, "<END_OF_FILE>\n");
+    conn_write(conn, out, len);
+    free(out);
+}
+
+int check_entry_permission(const char *username, File *file, char op) {
+    char permissions[7];
+    get_permissions(file, permissions);
+
     // Check if the user is the file owner
-    if (strcmp(file.owner, username) == 0) {
-        if ((op == 'r' && file.permissions[0] == 'r') || 
-            (op == 'w' && file.permissions[1] == 'w')) {
+    if (strcmp(file->owner, username) == 0) {
+        if ((op == 'r' && permissions[0] == 'r') || 
+            (op == 'w' && permissions[1] == 'w')) {
             return 1; // Has permission
         }
         return 0; // No permission
     }
 
     // Check if the user belongs to the same group as the file
-    if (strcmp(file.group, get_user_group(username)) == 0) {
-        if ((op == 'r' && file.permissions[2] == 'r') || 
-            (op == 'w' && file.permissions[3] == 'w')) {
+    if (strcmp(file->group, get_user_group(username)) == 0) {
+        if ((op == 'r' && permissions[2] == 'r') || 
+            (op == 'w' && permissions[3] == 'w')) {
             return 1; // Has permission
         }
         return 0; // No permission
     }
 
     // Check others' permissions
-    if ((op == 'r' && file.permissions[4] == 'r') || 
-        (op == 'w' && file.permissions[5] == 'w')) {
+    if ((op == 'r' && permissions[4] == 'r') || 
+        (op == 'w' && permissions[5] == 'w')) {
         return 1; // Has permission
     }
     return 0; // No permission
 }
 
+
+void get_permissions(File *file, char *out) {
+    traced_mutex_lock(&file->file_mutex, "file_mutex");
+    memcpy(out, file->permissions, sizeof(file->permissions));
+    traced_mutex_unlock(&file->file_mutex, "file_mutex");
+}
+
+int check_permission(const char *username, File *file, char op) {
+    // Every enclosing directory must be readable too, so restricting a
+    // directory restricts everything below it
+    for (PathNode *dir = file->node ? file->node->parent : NULL; dir != NULL; dir = dir->parent) {
+        if (!check_entry_permission(username, dir->data, 'r')) {
+            return 0;
+        }
+    }
+    return check_entry_permission(username, file, op);
+}
+
 const char* get_user_group(const char *username) {
+    // Return "unknown" if the user is not found
+    const char *group = "unknown";
+    pthread_mutex_lock(&data_mutex);
     for (int i = 0; i < user_count; i++) {
         if (strcmp(users[i].username, username) == 0) {
-            // Return the correct group
-            return users[i].group;
+            // Return the correct group; users are never removed, so the
+            // pointer stays valid after the lock is released
+            group = users[i].group;
+            break;
         }
     }
-    // Return "unknown" if the user is not found
-    return "unknown";
+    pthread_mutex_unlock(&data_mutex);
+    return group;
 }
 
-void send_user_list(int client_socket) {
-    char user_list[BUFFER_SIZE] = "";
-    strcat(user_list, "=== User List ===\n");
+void send_user_list(Conn *conn, char *user_list, size_t size) {
+    // MAX_USERS entries always fit in a small buffer
+    int len = snprintf(user_list, size, "=== User List ===\n");
+    pthread_mutex_lock(&data_mutex);
     if (user_count == 0) {
-        strcat(user_list, "No users available.\n");
+        len += snprintf(user_list + len, size - len, "No users available.\n");
     } else {
         for (int i = 0; i < user_count; i++) {
-            char user_entry[50];
-            snprintf(user_entry, sizeof(user_entry), "%d. %s (%s)\n", i + 1, users[i].username, users[i].group);
-            strcat(user_list, user_entry);
+            len += snprintf(user_list + len, size - len, "%d. %s (%s)\n", i + 1, users[i].username, users[i].group);
         }
     }
-    strcat(user_list, "==================\n");
-    write(client_socket, user_list, strlen(user_list));
+    pthread_mutex_unlock(&data_mutex);
+    len += snprintf(user_list + len, size - len, "==================\n");
+    conn_write(conn, user_list, len);
+}
+
+static int print_capability(PathNode *node, void *arg) {
+    File *file = node->data;
+    char path[MAX_PATH_LEN];
+    char permissions[7];
+    path_format(node, path, sizeof(path));
+    get_permissions(file, permissions);
+    printf("%s  %s  %s  %d  %s  %s%s\n",
+           permissions,
+           file->owner,
+           file->group,
+           file->size,
+           file->created_at,
+           path,
+           node->is_dir ? "/" : "");
+    return 0;
 }
 
 void show_capability_list() {
     printf("\n=== Capability List ===\n");
+    traced_rdlock(&ns_lock, "ns_lock");
     if (file_count == 0) {
         printf("No files available.\n");
+        traced_rwunlock(&ns_lock, "ns_lock");
         return;
     }
-
-    for (int i = 0; i < file_count; i++) {
-        printf("%s  %s  %s  %d  %s  %s\n",
-               files[i].permissions,
-               files[i].owner,
-               files[i].group,
-               files[i].size,
-               files[i].created_at,
-               files[i].filename);
+    if (file_count > CAPABILITY_LIST_LIMIT) {
+        printf("%d entries, too many to list (use ls).\n", file_count);
+        traced_rwunlock(&ns_lock, "ns_lock");
+        printf("========================\n");
+        return;
     }
+
+    path_walk(root_dir, print_capability, NULL);
+    traced_rwunlock(&ns_lock, "ns_lock");
     printf("========================\n");
 }
 
+static int destroy_file(PathNode *node, void *arg) {
+    File *file = node->data;
+    pthread_rwlock_destroy(&file->lock);
+    pthread_mutex_destroy(&file->file_mutex); // Destroy file-specific mutex
+    pthread_cond_destroy(&file->file_cond);
+    return 0;
+}
+
 void cleanup_files() {
-    for (int i = 0; i < file_count; i++) {
-        pthread_rwlock_destroy(&files[i].lock);
-        pthread_mutex_destroy(&files[i].file_mutex); // Destroy file-specific mutex
-        pthread_cond_destroy(&files[i].file_cond);
+    path_walk(root_dir, destroy_file, NULL);
+}
+
+void initialize_namespace() {
+    // The root directory belongs to the system and is open to everyone
+    File *root = new_file("rwrwrw", "system", "system", 1, NULL);
+    root_dir = path_new_root(root);
+    if (root == NULL || root_dir == NULL) {
+        perror("st");
+        exit(EXIT_FAILURE);
     }
+    root->node = root_dir;
 }
 
 void initialize_large_file() {
-    // Confirm there's space to add a file
-    if (file_count >= MAX_FILES) {
+    File *file = new_file("rwrwrw", "system", "AOS", 0, NULL);
+    if (file == NULL || (file->node = path_add_child(root_dir, "large", 0, file)) == NULL) {
         printf("LkЫعw]ɮסAwFɮ׼ƶqWC\n");
+        free(file);
         return;
     }
 
-    // Set file name
-    strncpy(files[file_count].filename, "large", sizeof(files[file_count].filename) - 1);
-    files[file_count].filename[sizeof(files[file_count].filename) - 1] = '\0';
-
-    // Set permissions
-    strncpy(files[file_count].permissions, "rwrwrw", sizeof(files[file_count].permissions) - 1);
-    files[file_count].permissions[sizeof(files[file_count].permissions) - 1] = '\0';
-
-    // Set owner
-    strncpy(files[file_count].owner, "system", sizeof(files[file_count].owner) - 1);
-    files[file_count].owner[sizeof(files[file_count].owner) - 1] = '\0';
-
-    // Set group
-    strncpy(files[file_count].group, "AOS", sizeof(files[file_count].group) - 1);
-    files[file_count].group[sizeof(files[file_count].group) - 1] = '\0';
-
     // Fill content with 'A'
-    memset(files[file_count].content, 'A', 65536);
+    file->content = malloc(65536);
+    if (file->content == NULL) {
+        perror("st");
+        return;
+    }
+    memset(file->content, 'A', 65536);
     // Ensure it ends with '\0'
-    files[file_count].content[65536 - 1] = '\0';
-    files[file_count].size = 65536 - 1;
-
-    // Record creation time
-    time_t now = time(NULL);
-    strftime(files[file_count].created_at, sizeof(files[file_count].created_at), "%Y-%m-%d %H:%M:%S", localtime(&now));
-
-    // Initialize lock
-    pthread_rwlock_init(&files[file_count].lock, NULL);
-    pthread_mutex_init(&files[file_count].file_mutex, NULL);
-
-    files[file_count].readers = 0;
-    atomic_store(&files[file_count].is_writing, 0);
+    file->content[65536 - 1] = '\0';
+    file->size = 65536 - 1;
+    file->capacity = 65536;
+    update_checksums(file, 0);
 
     // Update file count
     file_count++;
     printf("wlƹw]ɮסGlarge_file\n");
 }
 
+// Startup data from the -L, -M and -S options. Runs before the accept loop,
+// so the loaders can fill the namespace without taking ns_lock.
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void load_dataset(const char *spec_text, const char *map_image, const char *save_image) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (map_image != NULL) {
+        long n = dataset_load_image(map_image, (int)sysconf(_SC_NPROCESSORS_ONLN));
+        if (n < 0) {
+            fprintf(stderr, "LkJM %s\n", map_image);
+            exit(EXIT_FAILURE);
+        }
+        printf("wJM %sG%ld Ӷء]%.2f ^\n", map_image, n, seconds_since(&start));
+    }
+    if (spec_text != NULL) {
+        DatasetSpec spec;
+        if (dataset_parse(spec_text, &spec) < 0) {
+            fprintf(stderr, "ƶѼƿ~G%s\n", spec_text);
+            exit(EXIT_FAILURE);
+        }
+        long n = dataset_generate(&spec);
+        if (n < 0) {
+            fprintf(stderr, "Lk͸ƶ\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("w͸ƶG%ld Ӷء]%.2f ^\n", n, seconds_since(&start));
+    }
+    if (save_image != NULL) {
+        long n = dataset_save_image(save_image);
+        if (n < 0) {
+            fprintf(stderr, "LkgJM %s\n", save_image);
+            exit(EXIT_FAILURE);
+        }
+        printf("wgJM %sG%ld Ӷء]%.2f ^\n", save_image, n, seconds_since(&start));
+    }
+}
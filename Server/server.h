@@ -0,0 +1,91 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "bufpool.h"
+#include "pathindex.h"
+#include "transport.h"
+
+#define PORT 12500
+#define BUFFER_SIZE LARGE_BUFFER_SIZE
+#define LS_PAGE_SIZE 100 // entries returned by one ls command
+// One ls page: a line per entry (name plus at most 128 bytes of metadata),
+// the header and "more" lines with their paths, and the end marker
+#define LS_REPLY_SIZE (LS_PAGE_SIZE * (MAX_NAME_LEN + 128) + 2 * MAX_PATH_LEN + MAX_NAME_LEN + 128)
+#define CAPABILITY_LIST_LIMIT 1000 // larger namespaces print a summary instead
+#define DEFAULT_TRACE_PATH "aos_trace.json"
+#define MAX_USERS 20
+#define CHECKSUM_CHUNK (64 * 1024) // content bytes covered by each stored CRC32C
+#define MAX_CHUNKS (BUFFER_SIZE / CHECKSUM_CHUNK)
+#define SEARCH_PATTERN_MAX 255 // longest grep/count pattern
+
+typedef struct {
+    char username[20];
+    char group[20];
+} User;
+
+typedef struct {
+    PathNode *node;      // entry in the namespace (name, parent directory)
+    int is_dir;          // directories have no content
+    char permissions[7]; // rw-r--r, guarded by file_mutex since mode can change it
+    char owner[20];
+    char group[20];
+    char *content;       // grown on write up to BUFFER_SIZE - 1 bytes; capacity 0 means
+    int capacity;        // it points into a loaded image and is copied before changing
+    atomic_int size; // read without the rwlock by ls and the capability list
+    uint32_t chunk_crc[MAX_CHUNKS]; // CRC32C per CHECKSUM_CHUNK of content, kept in step by store_content
+    char created_at[30];
+    pthread_rwlock_t lock; // read-write lock
+    pthread_mutex_t file_mutex; // mutex for file
+    pthread_cond_t file_cond; // condition variable used for synchronous waiting
+    int readers;    // number of current reading clients
+    int is_writing; // indicates if it's currently being written to (0: no, 1: yes)
+} File;
+
+extern User users[MAX_USERS];
+extern int file_count;
+extern int user_count;
+extern pthread_mutex_t data_mutex;
+
+// Namespace: every file and directory hangs off root_dir. ns_lock guards the
+// tree structure and file_count; file contents use the per-file locks.
+extern PathNode *root_dir;
+extern pthread_rwlock_t ns_lock;
+
+// Result of create_entry
+enum {
+    CREATE_OK,
+    CREATE_EXISTS,
+    CREATE_NO_PARENT,
+    CREATE_DENIED,
+    CREATE_NO_MEMORY
+};
+
+// Function prototypes
+void *handle_client(void *arg);
+File *find_file(const char *path);
+File *new_file(const char *permissions, const char *owner, const char *group, int is_dir, const char *created_at);
+int create_entry(const char *username, const char *path, const char *permissions, int is_dir, File **out);
+int store_content(File *file, const char *data, int len, int append);
+void update_checksums(File *file, int from);
+int format_checksums(File *file, char *out, size_t size);
+void verify_content(File *file, const char *path, char *out, size_t size);
+void command_tail(const char *line, int words, char *out, size_t size);
+long search_content(Conn *conn, File *file, const char *pattern, char *out, size_t size);
+int receive_checked(Conn *conn, char *data, int capacity, char **content, int *content_len,
+                    char *error, size_t error_size);
+void list_directory(Conn *conn, const char *username, const char *path, const char *after);
+void initialize_namespace();
+void add_user(const char *username, const char *group);
+int check_permission(const char *username, File *file, char op);
+void get_permissions(File *file, char *out);
+const char* get_user_group(const char *username);
+void send_user_list(Conn *conn, char *user_list, size_t size);
+void show_capability_list();
+void cleanup_files();
+void initialize_large_file(); 
+void load_dataset(const char *spec_text, const char *map_image, const char *save_image);
+
+#endif
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shmring.h"
+
+#define SHM_MAGIC 0x41534d31 // "ASM1"
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// ring[side] is what this side reads; the other ring is what it writes
+static ShmRing *in_ring(ShmChannel *ch) {
+    return &ch->region->ring[ch->side];
+}
+
+static ShmRing *out_ring(ShmChannel *ch) {
+    return &ch->region->ring[1 - ch->side];
+}
+
+// The waiting flags double as futex words; the region is MAP_SHARED, so
+// these are shared (not FUTEX_PRIVATE) futexes
+static void wake_peer(ShmChannel *ch) {
+    atomic_int *word = &ch->region->waiting[1 - ch->side];
+    if (atomic_load(word) && atomic_exchange(word, 0)) {
+        syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// Data to read, or at least `need` bytes of room to write
+static int ring_ready(ShmRing *r, int for_space, size_t need) {
+    uint64_t used = atomic_load(&r->tail) - atomic_load(&r->head);
+    return for_space ? SHM_RING_SIZE - used >= need : used > 0;
+}
+
+static int peer_gone(ShmChannel *ch) {
+    // Nothing is sent on the socket once the rings are up, so any activity
+    // there means the peer closed it
+    struct pollfd pfd = { ch->sock_fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// Spin briefly, then sleep on our futex until the ring is ready. Setting
+// `waiting` before the final check, and the peer checking it after moving
+// head or tail, means a wakeup cannot be missed. The sleep times out now
+// and then to notice a peer that exited. Returns 0, or -1 if the peer is gone.
+static int wait_ring(ShmChannel *ch, ShmRing *r, int for_space, size_t need) {
+    for (int i = 0; i < ch->spin; i++) {
+        if (ring_ready(r, for_space, need)) {
+            return 0;
+        }
+        cpu_relax();
+    }
+
+    atomic_int *word = &ch->region->waiting[ch->side];
+    struct timespec timeout = { SHM_HANGUP_CHECK_MS / 1000, (SHM_HANGUP_CHECK_MS % 1000) * 1000000L };
+    while (1) {
+        atomic_store(word, 1);
+        if (ring_ready(r, for_space, need)) {
+            atomic_store(word, 0);
+            return 0;
+        }
+        if (syscall(SYS_futex, word, FUTEX_WAIT, 1, &timeout, NULL, 0) < 0 && errno == ETIMEDOUT) {
+            atomic_store(word, 0);
+            if (!ring_ready(r, for_space, need) && peer_gone(ch)) {
+                return -1;
+            }
+        }
+        if (ring_ready(r, for_space, need)) {
+            atomic_store(word, 0);
+            return 0;
+        }
+    }
+}
+
+static void copy_in(ShmRing *r, uint64_t pos, const char *src, size_t n) {
+    size_t offset = pos & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - offset ? n : SHM_RING_SIZE - offset;
+    memcpy(r->data + offset, src, first);
+    memcpy(r->data, src + first, n - first);
+}
+
+static int ring_put(ShmChannel *ch, const char *src, size_t n) {
+    ShmRing *r = out_ring(ch);
+    while (n > 0) {
+        if (wait_ring(ch, r, 1, 1) < 0) {
+            return -1;
+        }
+        uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        uint64_t room = SHM_RING_SIZE - (tail - atomic_load(&r->head));
+        size_t chunk = n < room ? n : room;
+
+        copy_in(r, tail, src, chunk);
+        atomic_store(&r->tail, tail + chunk);
+        wake_peer(ch);
+        src += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+static int ring_get(ShmChannel *ch, char *dst, size_t n) {
+    ShmRing *r = in_ring(ch);
+    while (n > 0) {
+        if (wait_ring(ch, r, 0, 0) < 0) {
+            return -1;
+        }
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+        uint64_t used = atomic_load(&r->tail) - head;
+        size_t chunk = n < used ? n : used;
+        size_t offset = head & (SHM_RING_SIZE - 1);
+        size_t first = chunk < SHM_RING_SIZE - offset ? chunk : SHM_RING_SIZE - offset;
+
+        memcpy(dst, r->data + offset, first);
+        memcpy(dst + first, r->data, chunk - first);
+        atomic_store(&r->head, head + chunk);
+        wake_peer(ch);
+        dst += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+ssize_t shm_read(ShmChannel *ch, void *buf, size_t count) {
+    if (ch->pending == 0) {
+        uint32_t len;
+        if (ring_get(ch, (char *)&len, sizeof(len)) < 0) {
+            return 0;
+        }
+        ch->pending = len;
+    }
+    size_t n = ch->pending < count ? ch->pending : count;
+    if (ring_get(ch, buf, n) < 0) {
+        return 0;
+    }
+    ch->pending -= n;
+    return n;
+}
+
+ssize_t shm_write(ShmChannel *ch, const void *buf, size_t count) {
+    // An empty message would read as end of stream, and a write of nothing
+    // sends nothing on a socket either
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t len = count;
+    if (count + sizeof(len) > SHM_RING_SIZE) {
+        // Too big to publish at once: stream it through as space frees up
+        if (ring_put(ch, (const char *)&len, sizeof(len)) < 0 || ring_put(ch, buf, count) < 0) {
+            return -1;
+        }
+        return count;
+    }
+
+    // Header and body become visible together, so the reader wakes once
+    ShmRing *r = out_ring(ch);
+    if (wait_ring(ch, r, 1, count + sizeof(len)) < 0) {
+        return -1;
+    }
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    copy_in(r, tail, (const char *)&len, sizeof(len));
+    copy_in(r, tail + sizeof(len), buf, count);
+    atomic_store(&r->tail, tail + sizeof(len) + count);
+    wake_peer(ch);
+    return count;
+}
+
+int shm_channel_offer(ShmChannel *ch, int sock_fd) {
+    memset(ch, 0, sizeof(*ch));
+    ch->side = SHM_SERVER;
+    ch->sock_fd = sock_fd;
+    // Spinning only pays off when the peer can run on another CPU
+    ch->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN : 0;
+
+    int mem_fd = memfd_create("aos_shm", MFD_CLOEXEC);
+    if (mem_fd < 0 || ftruncate(mem_fd, sizeof(ShmRegion)) < 0) {
+        goto fail;
+    }
+    ch->region = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+    if (ch->region == MAP_FAILED) {
+        ch->region = NULL;
+        goto fail;
+    }
+    ch->region->magic = SHM_MAGIC;
+    ch->region->ring_size = SHM_RING_SIZE;
+
+    // The reply text and the descriptor go out in one message
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { SHM_REPLY, strlen(SHM_REPLY) };
+    struct msghdr msg = { 0 };
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &mem_fd, sizeof(int));
+    if (sendmsg(sock_fd, &msg, 0) < 0) {
+        goto fail;
+    }
+    close(mem_fd);
+    return 0;
+
+fail:
+    if (mem_fd >= 0) {
+        close(mem_fd);
+    }
+    shm_channel_close(ch);
+    return -1;
+}
+
+int shm_channel_accept(ShmChannel *ch, int sock_fd) {
+    char text[64];
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { text, sizeof(text) - 1 };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    memset(ch, 0, sizeof(*ch));
+    ch->side = SHM_CLIENT;
+    ch->sock_fd = sock_fd;
+    // Spinning only pays off when the peer can run on another CPU
+    ch->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN : 0;
+
+    ssize_t n = recvmsg(sock_fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) {
+        return -1;
+    }
+    text[n] = '\0';
+
+    // A server that declined answers with plain text and no descriptor
+    int mem_fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+        memcpy(&mem_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (mem_fd < 0 || strcmp(text, SHM_REPLY) != 0) {
+        if (mem_fd >= 0) {
+            close(mem_fd);
+        }
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(mem_fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmRegion)) {
+        ch->region = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+        if (ch->region == MAP_FAILED) {
+            ch->region = NULL;
+        }
+    }
+    close(mem_fd);
+    if (ch->region == NULL || ch->region->magic != SHM_MAGIC || ch->region->ring_size != SHM_RING_SIZE) {
+        shm_channel_close(ch);
+        return -1;
+    }
+    return 0;
+}
+
+void shm_channel_close(ShmChannel *ch) {
+    if (ch->region != NULL) {
+        munmap(ch->region, sizeof(ShmRegion));
+        ch->region = NULL;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+// Shared-memory transport for clients on the same host. A client that
+// connects over the Unix socket can send "transport shm"; the server replies
+// "Transport: shm" and passes a memfd holding two single-producer rings over
+// the socket. Commands and replies then travel through the rings as
+// length-prefixed messages, so each read returns one whole message just like
+// the single read() the socket protocol relies on. A side with nothing to do
+// sleeps on a futex in the region; the socket stays open only so either side
+// notices when the other exits.
+
+#define SHM_RING_SIZE (1 << 20) // bytes per direction, a power of two
+#define SHM_SPIN 200            // polls of the ring before sleeping (multi-CPU hosts only)
+#define SHM_HANGUP_CHECK_MS 500 // how often a sleeping side checks the peer is still there
+#define SHM_REPLY "Transport: shm\n"
+
+enum { SHM_SERVER, SHM_CLIENT };
+
+typedef struct {
+    _Atomic uint64_t head; // consumer position
+    char pad1[56];
+    _Atomic uint64_t tail; // producer position
+    char pad2[56];
+    char data[SHM_RING_SIZE];
+} ShmRing;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ring_size;
+    atomic_int waiting[2]; // futex word, set by a side before it sleeps
+    char pad[48];
+    ShmRing ring[2];       // ring[SHM_SERVER] carries client to server traffic
+} ShmRegion;
+
+typedef struct {
+    ShmRegion *region;
+    int side;         // SHM_SERVER or SHM_CLIENT
+    int sock_fd;      // control socket; hangup means the peer is gone
+    int spin;         // ring polls before sleeping
+    uint32_t pending; // bytes left of the message being read
+} ShmChannel;
+
+// Server side: create the region and send it to the client
+// with the SHM_REPLY message. Returns 0 or -1.
+int shm_channel_offer(ShmChannel *ch, int sock_fd);
+
+// Client side: after sending "transport shm", wait for the reply and map the
+// region. Returns 0, or -1 if the server answered without descriptors.
+int shm_channel_accept(ShmChannel *ch, int sock_fd);
+
+// Read one message, or the next part of one larger than `count`. Blocks
+// until data arrives; returns 0 once the peer has gone.
+ssize_t shm_read(ShmChannel *ch, void *buf, size_t count);
+
+// Send `count` bytes as one message. Returns `count`, or -1 if the peer has gone.
+ssize_t shm_write(ShmChannel *ch, const void *buf, size_t count);
+
+// Unmap the region (the socket stays open).
+void shm_channel_close(ShmChannel *ch);
+
+#endif
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+typedef struct {
+    uint64_t ts;       // CLOCK_MONOTONIC, nanoseconds
+    const char *cat;
+    const char *name;
+    unsigned long value;
+    int tid;
+    char phase;        // 'B', 'E' or 'i'
+    char detail[19];
+} TraceEvent;
+
+#define EVENT_WORDS ((sizeof(TraceEvent) + 7) / 8)
+
+// A ring slot is a small seqlock: the owner sets seq odd, stores the event,
+// then sets it to 2 * (index + 1). The dumper keeps a copy only if seq was
+// that value both before and after copying, so an event being overwritten
+// is dropped rather than emitted torn. The event is kept as atomic words so
+// the overlapping copy is not a data race.
+typedef struct {
+    atomic_ulong seq;
+    _Atomic uint64_t words[EVENT_WORDS];
+} TraceSlot;
+
+// Rings are never freed: when a thread exits its ring is parked on the free
+// list with its events intact, and handed to the next thread that needs one.
+typedef struct TraceRing {
+    struct TraceRing *next;
+    int in_use;
+    atomic_ulong head; // total events ever written; slot is head % TRACE_RING_EVENTS
+    TraceSlot slots[TRACE_RING_EVENTS];
+} TraceRing;
+
+atomic_int trace_enabled = 0;
+__thread unsigned long trace_open_spans;
+
+static TraceRing *all_rings;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread TraceRing *my_ring;
+static __thread int my_tid;
+
+static void release_ring(void *arg) {
+    TraceRing *ring = arg;
+    pthread_mutex_lock(&rings_mutex);
+    ring->in_use = 0;
+    pthread_mutex_unlock(&rings_mutex);
+}
+
+static void make_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+static TraceRing *acquire_ring(void) {
+    TraceRing *ring;
+
+    pthread_once(&ring_key_once, make_ring_key);
+    pthread_mutex_lock(&rings_mutex);
+    for (ring = all_rings; ring != NULL; ring = ring->next) {
+        if (!ring->in_use) {
+            break;
+        }
+    }
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(TraceRing));
+        if (ring != NULL) {
+            ring->next = all_rings;
+            all_rings = ring;
+        }
+    }
+    if (ring != NULL) {
+        ring->in_use = 1;
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    if (ring != NULL) {
+        pthread_setspecific(ring_key, ring);
+        my_tid = (int)syscall(SYS_gettid);
+    }
+    return ring;
+}
+
+void trace_event(char phase, const char *cat, const char *name, const char *detail, unsigned long value) {
+    if (my_ring == NULL && (my_ring = acquire_ring()) == NULL) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    TraceEvent ev;
+    uint64_t words[EVENT_WORDS] = { 0 };
+    memset(&ev, 0, sizeof(ev));
+    ev.ts = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+    ev.cat = cat;
+    ev.name = name;
+    ev.value = value;
+    ev.tid = my_tid;
+    ev.phase = phase;
+    if (detail != NULL) {
+        strncpy(ev.detail, detail, sizeof(ev.detail) - 1);
+    }
+    memcpy(words, &ev, sizeof(ev));
+
+    unsigned long head = atomic_load_explicit(&my_ring->head, memory_order_relaxed);
+    TraceSlot *slot = &my_ring->slots[head % TRACE_RING_EVENTS];
+    atomic_store_explicit(&slot->seq, 2 * head + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < EVENT_WORDS; i++) {
+        atomic_store_explicit(&slot->words[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->seq, 2 * head + 2, memory_order_release);
+    atomic_store_explicit(&my_ring->head, head + 1, memory_order_release);
+}
+
+// Copy event `index` out of its slot. Returns 0, or -1 if the slot no
+// longer (or not yet) holds that event in full.
+static int copy_event(TraceRing *ring, unsigned long index, TraceEvent *out) {
+    TraceSlot *slot = &ring->slots[index % TRACE_RING_EVENTS];
+    uint64_t words[EVENT_WORDS];
+    unsigned long seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != 2 * index + 2) {
+        return -1;
+    }
+    for (size_t i = 0; i < EVENT_WORDS; i++) {
+        words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+        return -1;
+    }
+    memcpy(out, words, sizeof(*out));
+    return 0;
+}
+
+// Span bookkeeping shared with TRACE_BEGIN/TRACE_END, for spans that carry
+// a value at their start
+static void span_begin(const char *cat, const char *name, const char *detail, unsigned long value) {
+    int on = atomic_load_explicit(&trace_enabled, memory_order_relaxed);
+    trace_open_spans = trace_open_spans << 1 | on;
+    if (on) {
+        trace_event('B', cat, name, detail, value);
+    }
+}
+
+static void span_end(const char *cat, const char *name, unsigned long value) {
+    int on = trace_open_spans & 1;
+    trace_open_spans >>= 1;
+    if (on) {
+        trace_event('E', cat, name, NULL, value);
+    }
+}
+
+void traced_mutex_lock(pthread_mutex_t *m, const char *name) {
+    span_begin("lock_wait", name, NULL, (uintptr_t)m);
+    pthread_mutex_lock(m);
+    span_end("lock_wait", name, (uintptr_t)m);
+    span_begin("lock_hold", name, NULL, (uintptr_t)m);
+}
+
+void traced_mutex_unlock(pthread_mutex_t *m, const char *name) {
+    pthread_mutex_unlock(m);
+    span_end("lock_hold", name, (uintptr_t)m);
+}
+
+void traced_rdlock(pthread_rwlock_t *l, const char *name) {
+    span_begin("lock_wait", name, "read", (uintptr_t)l);
+    pthread_rwlock_rdlock(l);
+    span_end("lock_wait", name, (uintptr_t)l);
+    span_begin("lock_hold", name, "read", (uintptr_t)l);
+}
+
+void traced_wrlock(pthread_rwlock_t *l, const char *name) {
+    span_begin("lock_wait", name, "write", (uintptr_t)l);
+    pthread_rwlock_wrlock(l);
+    span_end("lock_wait", name, (uintptr_t)l);
+    span_begin("lock_hold", name, "write", (uintptr_t)l);
+}
+
+void traced_rwunlock(pthread_rwlock_t *l, const char *name) {
+    pthread_rwlock_unlock(l);
+    span_end("lock_hold", name, (uintptr_t)l);
+}
+
+ssize_t traced_read(int fd, void *buf, size_t count) {
+    TRACE_BEGIN("io", "read", NULL);
+    ssize_t n = read(fd, buf, count);
+    TRACE_END("io", "read", n > 0 ? (unsigned long)n : 0);
+    return n;
+}
+
+ssize_t traced_write(int fd, const void *buf, size_t count) {
+    TRACE_BEGIN("io", "write", NULL);
+    ssize_t n = write(fd, buf, count);
+    TRACE_END("io", "write", n > 0 ? (unsigned long)n : 0);
+    return n;
+}
+
+// JSON string body; bytes outside printable ASCII are replaced so the file
+// stays valid UTF-8 whatever the client sent
+static void write_json_text(FILE *out, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fputc('?', out);
+        } else {
+            fputc(c, out);
+        }
+    }
+}
+
+long trace_dump(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("trace dump");
+        return -1;
+    }
+
+    long count = 0;
+    pid_t pid = getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    pthread_mutex_lock(&rings_mutex);
+    for (TraceRing *ring = all_rings; ring != NULL; ring = ring->next) {
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+        for (unsigned long i = first; i < head; i++) {
+            // Events the owner overwrites while we copy are skipped
+            TraceEvent copy;
+            const TraceEvent *ev = &copy;
+            if (copy_event(ring, i, &copy) < 0) {
+                continue;
+            }
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d",
+                    count ? ",\n" : "", ev->name, ev->cat, ev->phase,
+                    (unsigned long long)(ev->ts / 1000), (unsigned long long)(ev->ts % 1000), (int)pid, ev->tid);
+            if (ev->phase == 'i') {
+                fprintf(out, ",\"s\":\"t\"");
+            }
+            fprintf(out, ",\"args\":{\"value\":%lu", ev->value);
+            if (ev->detail[0] != '\0') {
+                fprintf(out, ",\"detail\":\"");
+                write_json_text(out, ev->detail);
+                fputc('"', out);
+            }
+            fprintf(out, "}}");
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return count;
+}
+
+typedef struct {
+    int signo;
+    const char *path;
+} SignalDumper;
+
+static void *signal_dump_thread(void *arg) {
+    SignalDumper *sd = arg;
+    sigset_t set;
+    int sig;
+
+    sigemptyset(&set);
+    sigaddset(&set, sd->signo);
+    while (sigwait(&set, &sig) == 0) {
+        long n = trace_dump(sd->path);
+        if (n >= 0) {
+            printf("Trace: %ld events written to %s\n", n, sd->path);
+        }
+    }
+    return NULL;
+}
+
+void trace_dump_on_signal(int signo, const char *path) {
+    static SignalDumper sd;
+    sigset_t set;
+    pthread_t thread_id;
+
+    sd.signo = signo;
+    sd.path = path;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (pthread_create(&thread_id, NULL, signal_dump_thread, &sd) == 0) {
+        pthread_detach(thread_id);
+    }
+}
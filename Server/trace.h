@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+// Flight recorder for lock contention and request latency. Each thread
+// appends to its own ring buffer, so recording takes no locks; when tracing
+// is off every hook costs one relaxed load and a shift. Dumps are Chrome
+// trace JSON (open in chrome://tracing or ui.perfetto.dev).
+
+#define TRACE_RING_EVENTS 8192 // events kept per thread, oldest overwritten
+
+extern atomic_int trace_enabled;
+
+// One bit per open span of the calling thread, innermost lowest: set if its
+// begin was recorded. An end is recorded exactly when its begin was, so
+// turning tracing on or off mid-span never leaves a B or E unmatched.
+// Spans nested deeper than 64 lose their outermost bits.
+extern __thread unsigned long trace_open_spans;
+
+// Record an event. `cat` and `name` must be string literals; `detail` is
+// copied (truncated) and may be NULL. `value` is shown as an argument.
+void trace_event(char phase, const char *cat, const char *name, const char *detail, unsigned long value);
+
+#define TRACE_BEGIN(cat, name, detail) \
+    do { \
+        int trace_on_ = atomic_load_explicit(&trace_enabled, memory_order_relaxed); \
+        trace_open_spans = trace_open_spans << 1 | trace_on_; \
+        if (trace_on_) trace_event('B', cat, name, detail, 0); \
+    } while (0)
+#define TRACE_END(cat, name, value) \
+    do { \
+        int trace_on_ = trace_open_spans & 1; \
+        trace_open_spans >>= 1; \
+        if (trace_on_) trace_event('E', cat, name, NULL, value); \
+    } while (0)
+
+// Lock wrappers: record time spent waiting for and holding each lock
+void traced_mutex_lock(pthread_mutex_t *m, const char *name);
+void traced_mutex_unlock(pthread_mutex_t *m, const char *name);
+void traced_rdlock(pthread_rwlock_t *l, const char *name);
+void traced_wrlock(pthread_rwlock_t *l, const char *name);
+void traced_rwunlock(pthread_rwlock_t *l, const char *name);
+
+// Socket I/O wrappers: record each call and the bytes moved
+ssize_t traced_read(int fd, void *buf, size_t count);
+ssize_t traced_write(int fd, const void *buf, size_t count);
+
+// Write every buffered event to `path`. Returns the number of events
+// written, or -1 if the file cannot be created.
+long trace_dump(const char *path);
+
+// Dump to `path` whenever `signo` arrives. Call before starting any other
+// thread: it blocks `signo` in the caller so only the dumper receives it.
+void trace_dump_on_signal(int signo, const char *path);
+
+#endif
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "transport.h"
+#include "trace.h"
+#include "fairshare.h"
+
+Conn *conn_new(int fd, int is_local) {
+    Conn *conn = calloc(1, sizeof(Conn));
+    if (conn != NULL) {
+        conn->fd = fd;
+        conn->is_local = is_local;
+    }
+    return conn;
+}
+
+ssize_t conn_read(Conn *conn, void *buf, size_t count) {
+    ssize_t n;
+    if (conn->fair != NULL) {
+        fair_yield(conn->fair);
+    }
+    if (!conn->use_shm) {
+        n = traced_read(conn->fd, buf, count);
+    } else {
+        TRACE_BEGIN("io", "shm_read", NULL);
+        n = shm_read(&conn->shm, buf, count);
+        TRACE_END("io", "shm_read", n > 0 ? (unsigned long)n : 0);
+    }
+    if (n > 0) {
+        conn->bytes_in += n;
+    }
+    return n;
+}
+
+ssize_t conn_write(Conn *conn, const void *buf, size_t count) {
+    ssize_t n;
+    if (conn->fair != NULL) {
+        fair_yield(conn->fair);
+    }
+    if (!conn->use_shm) {
+        n = traced_write(conn->fd, buf, count);
+    } else {
+        TRACE_BEGIN("io", "shm_write", NULL);
+        n = shm_write(&conn->shm, buf, count);
+        TRACE_END("io", "shm_write", n > 0 ? (unsigned long)n : 0);
+    }
+    if (n > 0) {
+        conn->bytes_out += n;
+    }
+    return n;
+}
+
+int conn_use_shm(Conn *conn) {
+    if (!conn->is_local || conn->use_shm || shm_channel_offer(&conn->shm, conn->fd) < 0) {
+        return -1;
+    }
+    conn->use_shm = 1;
+    return 0;
+}
+
+void conn_close(Conn *conn) {
+    if (conn->use_shm) {
+        shm_channel_close(&conn->shm);
+    }
+    close(conn->fd);
+    free(conn);
+}
+
+int open_local_listener(const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,36 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <sys/types.h>
+#include "shmring.h"
+
+struct FairTicket;
+
+#define DEFAULT_SOCKET_PATH "/tmp/aos_fs.sock"
+
+// One client connection: a TCP or Unix socket, upgraded to the shared-memory
+// rings if a local client asks for them. Command handling only sees conn_read
+// and conn_write, which keep the socket protocol's one-read-per-message shape.
+typedef struct {
+    int fd;
+    int is_local;  // accepted on the Unix socket
+    int use_shm;
+    ShmChannel shm;
+    unsigned long bytes_in, bytes_out; // moved by conn_read and conn_write
+    struct FairTicket *fair; // current command's ticket; its slot is given back before any I/O
+} Conn;
+
+Conn *conn_new(int fd, int is_local);
+ssize_t conn_read(Conn *conn, void *buf, size_t count);
+ssize_t conn_write(Conn *conn, const void *buf, size_t count);
+
+// Switch a Unix socket connection to shared memory, replying to the client
+// on the socket. Returns 0, or -1 (connection unchanged) if not possible.
+int conn_use_shm(Conn *conn);
+
+void conn_close(Conn *conn);
+
+// Listening Unix socket at `path`, replacing any stale socket file.
+int open_local_listener(const char *path);
+
+#endif
@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include "shmring.h"
+#include "crc32c.h"
+#include "transport.h"
+
+// Load generator and invariant checker for the file server. Run the server
+// with -n so the simulated read/write delays do not dominate the numbers.
+//
+// Phase 1: every thread races to create the same set of names; each name
+//          must be created exactly once and show up in ls afterwards.
+// Phase 2: mixed read/write/ls traffic on a few shared files. Every write
+//          stores a self-describing record (seed, length, checksum), so any
+//          read that returns content which is not one whole record is a torn
+//          or corrupted read. Writes are sent with their CRC32C and reads
+//          are checked against the checksums the server returns.
+
+#define PORT 12500
+#define BUFFER_SIZE (512 * 1024)
+#define MAX_THREADS 64
+#define MAX_RACE_NAMES 1024
+#define END_MARKER "<END_OF_FILE>"
+
+// The server's concurrency refusals, in its Big5 text: a read of a file being
+// written ("...being written by another user") and a write to a file in use
+// ("...in use by another user"). Any other refusal is a protocol error.
+#define BUSY_BEING_WRITTEN "\xa5\xbf\xa6\x62\xb3\x51\xa8\xe4\xa5\x4c\xa8\xcf\xa5\xce\xaa\xcc\xbc\x67\xa4\x4a"
+#define BUSY_IN_USE "\xa5\xbf\xa6\x62\xb3\x51\xa8\xe4\xa5\x4c\xa8\xcf\xa5\xce\xaa\xcc\xbe\xde\xa7\x40"
+#define MAX_FDS 1024
+
+enum { OP_READ, OP_WRITE, OP_LS, OP_COUNT };
+static const char *op_names[OP_COUNT] = { "read", "write", "ls" };
+
+typedef struct {
+    atomic_long count;
+    atomic_long busy;      // rejected by the concurrency rules, not an error
+    atomic_long errors;
+    atomic_long total_ns;
+    atomic_long max_ns;
+} OpStats;
+
+// Options
+static const char *host = "127.0.0.1";
+static const char *transport = "tcp";
+static const char *socket_path = DEFAULT_SOCKET_PATH;
+static int num_threads = 8;
+static int duration = 10;
+static int num_files = 4;
+static int content_size = 1024;
+static int race_names = 32;
+
+static char run_dir[64];
+static OpStats stats[OP_COUNT];
+static atomic_int race_created[MAX_RACE_NAMES];
+static atomic_long torn_reads;
+static atomic_long protocol_errors;
+static atomic_long checksum_errors;
+static pthread_barrier_t start_barrier;
+static atomic_int stop;
+static ShmChannel *channels[MAX_FDS]; // by socket, for shm connections
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static uint32_t fnv1a(const char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void fill_payload(char *out, int len, uint32_t seed) {
+    uint32_t x = seed ? seed : 1;
+    for (int i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = 'a' + x % 26;
+    }
+}
+
+// Record: "REC <seed> <length> <checksum>\n" followed by <length> letters
+static int make_record(char *out, uint32_t seed, int len) {
+    char *payload = out + 64;
+    fill_payload(payload, len, seed);
+    int hlen = snprintf(out, 64, "REC %08x %d %08x\n", seed, len, fnv1a(payload, len));
+    memmove(out + hlen, payload, len);
+    out[hlen + len] = '\0';
+    return hlen + len;
+}
+
+// A file that was never written is empty; anything else must be one record
+static int valid_record(const char *content, int len, char *scratch) {
+    unsigned seed, sum;
+    int plen;
+    if (len == 0) {
+        return 1;
+    }
+    const char *nl = memchr(content, '\n', len);
+    if (nl == NULL || sscanf(content, "REC %8x %d %8x", &seed, &plen, &sum) != 3) {
+        return 0;
+    }
+    int hlen = nl - content + 1;
+    if (plen < 0 || hlen + plen != len) {
+        return 0;
+    }
+    fill_payload(scratch, plen, seed);
+    return memcmp(scratch, content + hlen, plen) == 0 && fnv1a(content + hlen, plen) == sum;
+}
+
+static ssize_t link_read(int fd, void *buf, size_t count) {
+    return channels[fd] ? shm_read(channels[fd], buf, count) : read(fd, buf, count);
+}
+
+static ssize_t link_write(int fd, const void *buf, size_t count) {
+    return channels[fd] ? shm_write(channels[fd], buf, count) : write(fd, buf, count);
+}
+
+static int connect_local() {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    if (fd >= MAX_FDS || strcmp(transport, "shm") != 0) {
+        return fd;
+    }
+
+    ShmChannel *ch = malloc(sizeof(ShmChannel));
+    if (ch == NULL || write(fd, "transport shm", 13) < 0 || shm_channel_accept(ch, fd) < 0) {
+        fprintf(stderr, "shared memory transport refused\n");
+        free(ch);
+        close(fd);
+        return -1;
+    }
+    channels[fd] = ch;
+    return fd;
+}
+
+static int connect_server() {
+    struct sockaddr_in addr;
+    if (strcmp(transport, "tcp") != 0) {
+        return connect_local();
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void disconnect_server(int fd) {
+    if (channels[fd]) {
+        shm_channel_close(channels[fd]);
+        free(channels[fd]);
+        channels[fd] = NULL;
+    }
+    close(fd);
+}
+
+// Send a command and read a one-shot reply
+static int request(int fd, const char *cmd, char *reply, size_t size) {
+    if (link_write(fd, cmd, strlen(cmd)) < 0) {
+        return -1;
+    }
+    int n = link_read(fd, reply, size - 1);
+    if (n <= 0) {
+        return -1;
+    }
+    reply[n] = '\0';
+    return n;
+}
+
+// Send a command and read until the reply contains <END_OF_FILE>
+static int request_until_end(int fd, const char *cmd, char *reply, size_t size) {
+    size_t len = 0;
+    if (link_write(fd, cmd, strlen(cmd)) < 0) {
+        return -1;
+    }
+    while (len < size - 1) {
+        int n = link_read(fd, reply + len, size - 1 - len);
+        if (n <= 0) {
+            return -1;
+        }
+        len += n;
+        reply[len] = '\0';
+        // Only the newly received bytes (plus marker overlap) need scanning
+        size_t from = len > (size_t)n + sizeof(END_MARKER) ? len - n - sizeof(END_MARKER) : 0;
+        const char *marker = strstr(reply + from, END_MARKER);
+        // Read replies carry checksums after the marker, up to a newline
+        if (marker != NULL && (strncmp(marker + strlen(END_MARKER), " crc32c", 7) != 0 ||
+                               strchr(marker, '\n') != NULL)) {
+            return (int)len;
+        }
+    }
+    return -1;
+}
+
+static int login(int fd, const char *user, char *reply, size_t size) {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "set_user %s", user);
+    return request(fd, cmd, reply, size) > 0 && strstr(reply, "User:") != NULL ? 0 : -1;
+}
+
+static void record_op(int op, long start, int busy, int error) {
+    long ns = now_ns() - start;
+    OpStats *st = &stats[op];
+    atomic_fetch_add(&st->count, 1);
+    atomic_fetch_add(&st->total_ns, ns);
+    if (busy) {
+        atomic_fetch_add(&st->busy, 1);
+    }
+    if (error) {
+        atomic_fetch_add(&st->errors, 1);
+    }
+    long max = atomic_load(&st->max_ns);
+    while (ns > max && !atomic_compare_exchange_weak(&st->max_ns, &max, ns)) {
+    }
+}
+
+// Trailer: " crc32c size=<n> chunk=<bytes> sums=<hex>,<hex>,..."
+static int checksums_match(const char *content, int len, const char *trailer) {
+    int size, chunk, pos = 0;
+    if (sscanf(trailer, " crc32c size=%d chunk=%d sums=%n", &size, &chunk, &pos) != 2 || pos == 0 ||
+        chunk <= 0 || size != len) {
+        return 0;
+    }
+    const char *sums = trailer + pos;
+    for (int start = 0; start < len; start += chunk) {
+        unsigned expected;
+        int n = len - start < chunk ? len - start : chunk;
+        if (sscanf(sums, "%8x", &expected) != 1 || crc32c(0, content + start, n) != expected) {
+            return 0;
+        }
+        sums += strcspn(sums, ",\n");
+        sums += *sums == ',';
+    }
+    return 1;
+}
+
+static void do_read(int fd, const char *path, char *reply, char *scratch) {
+    char cmd[160];
+    long start = now_ns();
+    snprintf(cmd, sizeof(cmd), "read %s", path);
+    int n = request_until_end(fd, cmd, reply, BUFFER_SIZE + 64);
+    if (n < 0) {
+        atomic_fetch_add(&protocol_errors, 1);
+        record_op(OP_READ, start, 0, 1);
+        return;
+    }
+    // Content is followed by "\n<END_OF_FILE> crc32c ...\n"; refusals end at the marker
+    char *marker = strstr(reply, "\n" END_MARKER " crc32c");
+    if (marker == NULL) {
+        int busy = strstr(reply, BUSY_BEING_WRITTEN) != NULL;
+        if (!busy) {
+            atomic_fetch_add(&protocol_errors, 1);
+        }
+        record_op(OP_READ, start, busy, !busy);
+        return;
+    }
+    int len = marker - reply;
+    if (!checksums_match(reply, len, marker + 1 + strlen(END_MARKER))) {
+        atomic_fetch_add(&checksum_errors, 1);
+        record_op(OP_READ, start, 0, 1);
+        return;
+    }
+    if (!valid_record(reply, len, scratch)) {
+        atomic_fetch_add(&torn_reads, 1);
+        record_op(OP_READ, start, 0, 1);
+        return;
+    }
+    record_op(OP_READ, start, 0, 0);
+}
+
+static void do_write(int fd, const char *path, unsigned *rng, char *reply, char *record) {
+    char cmd[160];
+    long start = now_ns();
+    snprintf(cmd, sizeof(cmd), "write %s o crc", path);
+    if (request(fd, cmd, reply, 4096) < 0) {
+        atomic_fetch_add(&protocol_errors, 1);
+        record_op(OP_WRITE, start, 0, 1);
+        return;
+    }
+    if (strncmp(reply, "Ready to write", 14) != 0) {
+        int busy = strstr(reply, BUSY_IN_USE) != NULL;
+        if (!busy) {
+            atomic_fetch_add(&protocol_errors, 1);
+        }
+        record_op(OP_WRITE, start, busy, !busy);
+        return;
+    }
+    // Header and record go out as one message: "<length> <crc32c>\n<record>"
+    int len = make_record(record + 32, (uint32_t)rand_r(rng) * 2654435761u + 1, 1 + rand_r(rng) % content_size);
+    int hlen = snprintf(record, 32, "%d %08x\n", len, crc32c(0, record + 32, len));
+    memmove(record + hlen, record + 32, len + 1);
+    if (request(fd, record, reply, 4096) < 0 || strstr(reply, "completed") == NULL) {
+        atomic_fetch_add(&protocol_errors, 1);
+        record_op(OP_WRITE, start, 0, 1);
+        return;
+    }
+    record_op(OP_WRITE, start, 0, 0);
+}
+
+static void do_ls(int fd, char *reply) {
+    char cmd[160];
+    long start = now_ns();
+    snprintf(cmd, sizeof(cmd), "ls %s", run_dir);
+    int n = request_until_end(fd, cmd, reply, BUFFER_SIZE + 64);
+    int ok = n > 0 && strncmp(reply, "===", 3) == 0;
+    if (!ok) {
+        atomic_fetch_add(&protocol_errors, 1);
+    }
+    record_op(OP_LS, start, 0, !ok);
+}
+
+static void *worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    unsigned rng = (unsigned)time(NULL) ^ (id * 7919u);
+    char *reply = malloc(BUFFER_SIZE + 64);
+    char *scratch = malloc(BUFFER_SIZE);
+    char *record = malloc(content_size + 160);
+    char path[128];
+    int fd = connect_server();
+
+    if (fd < 0 || reply == NULL || scratch == NULL || record == NULL ||
+        login(fd, id % 2 ? "stress_cse" : "stress_aos", reply, 4096) < 0) {
+        fprintf(stderr, "worker %d: setup failed\n", id);
+        atomic_fetch_add(&protocol_errors, 1);
+        pthread_barrier_wait(&start_barrier);
+        goto out;
+    }
+
+    // Phase 1: everyone creates the same names, each in a different order
+    pthread_barrier_wait(&start_barrier);
+    int offset = rand_r(&rng) % race_names;
+    for (int i = 0; i < race_names; i++) {
+        int j = (i + offset) % race_names;
+        char cmd[160];
+        snprintf(cmd, sizeof(cmd), "create %s/race%04d rwrwrw", run_dir, j);
+        if (request(fd, cmd, reply, 4096) < 0) {
+            atomic_fetch_add(&protocol_errors, 1);
+        } else if (strstr(reply, "Created") != NULL) {
+            atomic_fetch_add(&race_created[j], 1);
+        }
+    }
+
+    // Phase 2: mixed traffic until the main thread says stop
+    while (!atomic_load(&stop)) {
+        int r = rand_r(&rng) % 100;
+        snprintf(path, sizeof(path), "%s/data%d", run_dir, rand_r(&rng) % num_files);
+        if (r < 60) {
+            do_read(fd, path, reply, scratch);
+        } else if (r < 90) {
+            do_write(fd, path, &rng, reply, record);
+        } else {
+            do_ls(fd, reply);
+        }
+    }
+
+out:
+    if (fd >= 0) {
+        disconnect_server(fd);
+    }
+    free(reply);
+    free(scratch);
+    free(record);
+    return NULL;
+}
+
+// Check that every race name was created exactly once and is listed
+static int check_race(int fd, char *reply, long *duplicates, long *lost) {
+    char cmd[256];
+    char after[64] = "";
+    int listed[MAX_RACE_NAMES] = { 0 };
+
+    // Page through the race names with ls <dir>/race* <after>
+    int more = 1;
+    while (more) {
+        snprintf(cmd, sizeof(cmd), "ls %s/race* %s", run_dir, after);
+        if (request_until_end(fd, cmd, reply, BUFFER_SIZE + 64) < 0 || strncmp(reply, "===", 3) != 0) {
+            return -1;
+        }
+        more = strstr(reply, "-- more:") != NULL;
+        for (char *line = strtok(reply, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+            char *name = strstr(line, "race");
+            int j;
+            if (strncmp(line, "-- more:", 8) == 0 || strncmp(line, "===", 3) == 0 || name == NULL) {
+                continue;
+            }
+            if (sscanf(name, "race%d", &j) == 1 && j >= 0 && j < race_names) {
+                listed[j]++;
+                snprintf(after, sizeof(after), "race%04d", j);
+            }
+        }
+    }
+
+    *duplicates = 0;
+    *lost = 0;
+    for (int j = 0; j < race_names; j++) {
+        int created = atomic_load(&race_created[j]);
+        if (created > 1) {
+            *duplicates += created - 1;
+        }
+        if (created != listed[j] || created == 0) {
+            (*lost)++;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-H host] [-x tcp|unix|shm] [-U socket_path] [-c threads] [-d seconds] [-f files] [-s max_content] [-r race_names]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "H:x:U:c:d:f:s:r:")) != -1) {
+        switch (opt) {
+        case 'H': host = optarg; break;
+        case 'x': transport = optarg; break;
+        case 'U': socket_path = optarg; break;
+        case 'c': num_threads = atoi(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 'f': num_files = atoi(optarg); break;
+        case 's': content_size = atoi(optarg); break;
+        case 'r': race_names = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (num_threads < 1 || num_threads > MAX_THREADS || num_files < 1 || content_size < 1 ||
+        content_size > BUFFER_SIZE / 2 || race_names < 0 || race_names > MAX_RACE_NAMES ||
+        (strcmp(transport, "tcp") != 0 && strcmp(transport, "unix") != 0 && strcmp(transport, "shm") != 0)) {
+        usage(argv[0]);
+    }
+
+    char *reply = malloc(BUFFER_SIZE + 64);
+    int fd = connect_server();
+    if (fd < 0 || reply == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Setup: two users in different groups and a fresh directory for this run
+    snprintf(run_dir, sizeof(run_dir), "stress_%d", (int)getpid());
+    request(fd, "create_user stress_aos AOS", reply, 4096);
+    request(fd, "create_user stress_cse CSE", reply, 4096);
+    if (login(fd, "stress_aos", reply, 4096) < 0) {
+        fprintf(stderr, "Cannot log in as stress_aos: %s", reply);
+        exit(EXIT_FAILURE);
+    }
+    char cmd[160];
+    snprintf(cmd, sizeof(cmd), "mkdir %s rwrwrw", run_dir);
+    request(fd, cmd, reply, 4096);
+    for (int i = 0; i < num_files; i++) {
+        snprintf(cmd, sizeof(cmd), "create %s/data%d rwrwrw", run_dir, i);
+        if (request(fd, cmd, reply, 4096) < 0 || strstr(reply, "Created") == NULL) {
+            fprintf(stderr, "Cannot create %s/data%d: %s", run_dir, i, reply);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_t threads[MAX_THREADS];
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i);
+    }
+    pthread_barrier_wait(&start_barrier);
+    long start = now_ns();
+    sleep(duration);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    // Final pass: every data file must hold one whole record
+    char *scratch = malloc(BUFFER_SIZE);
+    for (int i = 0; i < num_files && scratch != NULL; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), "%s/data%d", run_dir, i);
+        do_read(fd, path, reply, scratch);
+    }
+
+    long duplicates = 0, lost = 0;
+    if (check_race(fd, reply, &duplicates, &lost) < 0) {
+        atomic_fetch_add(&protocol_errors, 1);
+    }
+
+    long total = 0;
+    printf("=== Stress results: %d threads, %.1f s, run dir %s ===\n", num_threads, elapsed, run_dir);
+    printf("%-6s %10s %8s %8s %10s %10s\n", "op", "count", "busy", "errors", "avg_ms", "max_ms");
+    for (int op = 0; op < OP_COUNT; op++) {
+        long count = atomic_load(&stats[op].count);
+        total += count;
+        printf("%-6s %10ld %8ld %8ld %10.3f %10.3f\n", op_names[op], count,
+               atomic_load(&stats[op].busy), atomic_load(&stats[op].errors),
+               count ? atomic_load(&stats[op].total_ns) / 1e6 / count : 0.0,
+               atomic_load(&stats[op].max_ns) / 1e6);
+    }
+    printf("throughput: %.0f ops/s\n", total / elapsed);
+    printf("create race: %d names, %ld duplicate creates, %ld lost or missing\n", race_names, duplicates, lost);
+    printf("torn reads: %ld, checksum errors: %ld, protocol errors: %ld\n", atomic_load(&torn_reads),
+           atomic_load(&checksum_errors), atomic_load(&protocol_errors));
+
+    int failed = duplicates || lost || atomic_load(&torn_reads) || atomic_load(&checksum_errors) ||
+                 atomic_load(&protocol_errors);
+    printf("%s\n", failed ? "FAILED" : "OK");
+    disconnect_server(fd);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}